@@ -11,6 +11,8 @@
 // along with this software. If not, see <http://creativecommons.org/publicdomain/zero/1.0/>.
 //==============================================================================================
 
+#include "simd.h"
+
 
 class aabb {
   public:
@@ -48,28 +50,65 @@ class aabb {
     }
 
     bool hit(const ray& r, interval ray_t) const {
+        // Slab test using the ray's precomputed inverse direction. Along an axis where the ray
+        // points toward negative coordinates it enters the max slab first, so the near and far
+        // distances are picked by direction sign instead of by comparing them. A ray lying in
+        // the plane of a slab gives 0 * infinity = NaN there, and that axis is then ignored.
+
+      #if RTW_SIMD_X86
+        // x and y share one register and z fills both lanes of another. The maxpd and minpd
+        // instructions return their second operand when either one is NaN.
+        const auto& o = r.origin();
+        const auto& inv = r.inverse_direction();
+
+        auto o_xy = _mm_set_pd(o.y(), o.x());
+        auto o_zz = _mm_set1_pd(o.z());
+        auto inv_xy = _mm_set_pd(inv.y(), inv.x());
+        auto inv_zz = _mm_set1_pd(inv.z());
+
+        auto lo_xy = _mm_mul_pd(_mm_sub_pd(_mm_set_pd(y.min, x.min), o_xy), inv_xy);
+        auto hi_xy = _mm_mul_pd(_mm_sub_pd(_mm_set_pd(y.max, x.max), o_xy), inv_xy);
+        auto lo_zz = _mm_mul_pd(_mm_sub_pd(_mm_set1_pd(z.min), o_zz), inv_zz);
+        auto hi_zz = _mm_mul_pd(_mm_sub_pd(_mm_set1_pd(z.max), o_zz), inv_zz);
+
+        auto neg_xy = _mm_cmplt_pd(inv_xy, _mm_setzero_pd());
+        auto neg_zz = _mm_cmplt_pd(inv_zz, _mm_setzero_pd());
+        auto select = [](__m128d mask, __m128d a, __m128d b) {
+            return _mm_or_pd(_mm_and_pd(mask, a), _mm_andnot_pd(mask, b));
+        };
+
+        auto t_min = _mm_max_pd(select(neg_xy, hi_xy, lo_xy), _mm_set1_pd(ray_t.min));
+        t_min = _mm_max_pd(select(neg_zz, hi_zz, lo_zz), t_min);
+        auto t_max = _mm_min_pd(select(neg_xy, lo_xy, hi_xy), _mm_set1_pd(ray_t.max));
+        t_max = _mm_min_pd(select(neg_zz, lo_zz, hi_zz), t_max);
+
+        t_min = _mm_max_sd(t_min, _mm_unpackhi_pd(t_min, t_min));
+        t_max = _mm_min_sd(t_max, _mm_unpackhi_pd(t_max, t_max));
+        return _mm_comilt_sd(t_min, t_max);
+      #else
         const point3& ray_orig = r.origin();
-        const vec3&   ray_dir  = r.direction();
+        const vec3&   ray_inv  = r.inverse_direction();
 
         for (int axis = 0; axis < 3; axis++) {
             const interval& ax = axis_interval(axis);
-            const double adinv = 1.0 / ray_dir[axis];
-
-            auto t0 = (ax.min - ray_orig[axis]) * adinv;
-            auto t1 = (ax.max - ray_orig[axis]) * adinv;
+            bool neg = r.is_negative(axis);
 
-            if (t0 < t1) {
-                if (t0 > ray_t.min) ray_t.min = t0;
-                if (t1 < ray_t.max) ray_t.max = t1;
-            } else {
-                if (t1 > ray_t.min) ray_t.min = t1;
-                if (t0 < ray_t.max) ray_t.max = t0;
-            }
+            auto t_near = ((neg ? ax.max : ax.min) - ray_orig[axis]) * ray_inv[axis];
+            auto t_far  = ((neg ? ax.min : ax.max) - ray_orig[axis]) * ray_inv[axis];
 
-            if (ray_t.max <= ray_t.min)
-                return false;
+            ray_t.min = t_near > ray_t.min ? t_near : ray_t.min;
+            ray_t.max = t_far < ray_t.max ? t_far : ray_t.max;
         }
-        return true;
+        return ray_t.min < ray_t.max;
+      #endif
+    }
+
+    double surface_area() const {
+        // Returns the surface area of the box, or zero if the box is empty.
+        auto dx = x.size(), dy = y.size(), dz = z.size();
+        if (dx < 0 || dy < 0 || dz < 0)
+            return 0;
+        return 2 * (dx*dy + dy*dz + dz*dx);
     }
 
     int longest_axis() const {
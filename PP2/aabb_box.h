@@ -0,0 +1,139 @@
+#ifndef AABB_BOX_H
+#define AABB_BOX_H
+//==============================================================================================
+// To the extent possible under law, the author(s) have dedicated all copyright and related and
+// neighboring rights to this software to the public domain worldwide. This software is
+// distributed without any warranty.
+//
+// You should have received a copy (see file COPYING.txt) of the CC0 Public Domain Dedication
+// along with this software. If not, see <http://creativecommons.org/publicdomain/zero/1.0/>.
+//==============================================================================================
+
+#include "hittable.h"
+
+
+class aabb_box : public hittable {
+  public:
+    // An axis-aligned box, intersected with a single slab test instead of as six quads. Each
+    // face can have its own material. Following box(), the front face is the one at maximum Z
+    // and the right face the one at maximum X.
+
+    aabb_box(const point3& a, const point3& b, shared_ptr<material> mat)
+      : aabb_box(a, b, mat, mat, mat, mat, mat, mat) {}
+
+    aabb_box(
+        const point3& a, const point3& b,
+        shared_ptr<material> front, shared_ptr<material> back,
+        shared_ptr<material> left,  shared_ptr<material> right,
+        shared_ptr<material> top,   shared_ptr<material> bottom
+    ) : bbox(a, b)
+    {
+        // Face materials indexed by axis, then by side (minimum, maximum).
+        face_mat[0][0] = left;   face_mat[0][1] = right;
+        face_mat[1][0] = bottom; face_mat[1][1] = top;
+        face_mat[2][0] = back;   face_mat[2][1] = front;
+    }
+
+    bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
+        const vec3& ray_dir = r.direction();
+
+        double t_near, t_far;
+        int near_axis, far_axis;
+        if (!clip(r, t_near, t_far, near_axis, far_axis))
+            return false;
+
+        // Take the entry point if it lies in the ray interval, otherwise the exit point (for
+        // rays that start inside the box).
+        double t;
+        int axis;
+        bool entering;
+        if (near_axis >= 0 && ray_t.contains(t_near)) {
+            t = t_near;
+            axis = near_axis;
+            entering = true;
+        } else if (far_axis >= 0 && ray_t.contains(t_far)) {
+            t = t_far;
+            axis = far_axis;
+            entering = false;
+        } else {
+            return false;
+        }
+
+        // The ray enters through the face it is heading into and exits through the one it is
+        // heading out of, which tells us which side of the slab was hit.
+        int side = (ray_dir[axis] > 0) ? (entering ? 0 : 1) : (entering ? 1 : 0);
+
+        rec.t = t;
+        rec.p = r.at(t);
+        rec.mat = face_mat[axis][side];
+        rec.object = this;
+
+        vec3 outward_normal(0,0,0);
+        outward_normal[axis] = side ? 1 : -1;
+        rec.set_face_normal(r, outward_normal);
+
+        // Face UVs match the quads of the block scenes: the X faces map U along Z, the Z faces
+        // map U along X, and the top and bottom map U along X and V along Z. V runs up Y on the
+        // sides.
+        auto fraction = [&](int a) {
+            const interval& ax = bbox.axis_interval(a);
+            return ax.size() > 0 ? interval(0,1).clamp((rec.p[a] - ax.min) / ax.size()) : 0.0;
+        };
+
+        if (axis == 0)      { rec.u = fraction(2); rec.v = fraction(1); }
+        else if (axis == 1) { rec.u = fraction(0); rec.v = fraction(2); }
+        else                { rec.u = fraction(0); rec.v = fraction(1); }
+
+        return true;
+    }
+
+    bool occluded(const ray& r, interval ray_t) const override {
+        double t_near, t_far;
+        int near_axis, far_axis;
+        if (!clip(r, t_near, t_far, near_axis, far_axis))
+            return false;
+
+        return (near_axis >= 0 && ray_t.contains(t_near))
+            || (far_axis >= 0 && ray_t.contains(t_far));
+    }
+
+    aabb bounding_box() const override { return bbox; }
+
+  private:
+    aabb bbox;
+    shared_ptr<material> face_mat[3][2];
+
+    bool clip(const ray& r, double& t_near, double& t_far, int& near_axis, int& far_axis) const {
+        // Intersect the three slabs, remembering which axis bounds the ray on entry and exit.
+        // Returns false if the ray's line misses the box.
+        const point3& ray_orig = r.origin();
+        const vec3&   ray_dir  = r.direction();
+
+        t_near = -infinity;
+        t_far = infinity;
+        near_axis = far_axis = -1;
+
+        for (int axis = 0; axis < 3; axis++) {
+            const interval& ax = bbox.axis_interval(axis);
+
+            if (ray_dir[axis] == 0) {
+                if (ray_orig[axis] < ax.min || ray_orig[axis] > ax.max)
+                    return false;
+                continue;
+            }
+
+            const double adinv = r.inverse_direction()[axis];
+            auto t0 = (ax.min - ray_orig[axis]) * adinv;
+            auto t1 = (ax.max - ray_orig[axis]) * adinv;
+            if (t0 > t1) std::swap(t0, t1);
+
+            if (t0 > t_near) { t_near = t0; near_axis = axis; }
+            if (t1 < t_far)  { t_far = t1;  far_axis = axis; }
+        }
+
+        return t_near <= t_far;
+    }
+};
+
+
+#endif
@@ -0,0 +1,98 @@
+//==============================================================================================
+// To the extent possible under law, the author(s) have dedicated all copyright and related and
+// neighboring rights to this software to the public domain worldwide. This software is
+// distributed without any warranty.
+//
+// You should have received a copy (see file COPYING.txt) of the CC0 Public Domain Dedication
+// along with this software. If not, see <http://creativecommons.org/publicdomain/zero/1.0/>.
+//==============================================================================================
+
+// Microbenchmark do teste raio-caixa (aabb::hit), que é executado a cada nó visitado na BVH.
+// Compara o teste antigo, que divide pela direção e ordena t0/t1 com desvios, com o teste atual,
+// que usa o inverso da direção pré-calculado no raio e operações min/max sem desvios.
+//
+// Para compilar e rodar:
+//     g++ -O2 bench_aabb.cc -o bench_aabb
+//     ./bench_aabb
+
+#include "rtweekend.h"
+#include "aabb.h"
+
+#include <chrono>
+#include <cstdio>
+#include <vector>
+
+
+// Teste de caixa como era antes do pré-cálculo no raio
+bool legacy_box_hit(const aabb& box, const ray& r, interval ray_t) {
+    const point3& ray_orig = r.origin();
+    const vec3&   ray_dir  = r.direction();
+
+    for (int axis = 0; axis < 3; axis++) {
+        const interval& ax = box.axis_interval(axis);
+        const double adinv = 1.0 / ray_dir[axis];
+
+        auto t0 = (ax.min - ray_orig[axis]) * adinv;
+        auto t1 = (ax.max - ray_orig[axis]) * adinv;
+
+        if (t0 < t1) {
+            if (t0 > ray_t.min) ray_t.min = t0;
+            if (t1 < ray_t.max) ray_t.max = t1;
+        } else {
+            if (t1 > ray_t.min) ray_t.min = t1;
+            if (t0 < ray_t.max) ray_t.max = t0;
+        }
+
+        if (ray_t.max <= ray_t.min)
+            return false;
+    }
+    return true;
+}
+
+template <typename BoxHit>
+double best_time(const std::vector<aabb>& boxes, const std::vector<ray>& rays, BoxHit box_hit,
+                 long& hits)
+{
+    // Melhor tempo (em segundos) de algumas repetições testando cada raio contra cada caixa
+    double best = infinity;
+    for (int rep = 0; rep < 5; rep++) {
+        hits = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (const auto& r : rays)
+            for (const auto& box : boxes)
+                hits += box_hit(box, r, interval(0.001, infinity));
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        best = std::fmin(best, elapsed.count());
+    }
+    return best;
+}
+
+int main() {
+    seed_thread_rng(1, 0, 0);
+
+    // Caixas pequenas espalhadas em um cubo, como nós internos de uma BVH
+    std::vector<aabb> boxes;
+    for (int i = 0; i < 1024; i++) {
+        auto a = point3::random(-10, 10);
+        boxes.push_back(aabb(a, a + vec3::random(0.1, 4)));
+    }
+
+    // Raios de dentro do cubo em direções aleatórias; como na travessia da BVH, a maioria erra
+    std::vector<ray> rays;
+    for (int i = 0; i < 4096; i++)
+        rays.push_back(ray(point3::random(-12, 12), vec3::random(-1, 1), random_double()));
+
+    long legacy_hits, hits;
+    auto legacy = best_time(boxes, rays, legacy_box_hit, legacy_hits);
+    auto current = best_time(boxes, rays,
+        [](const aabb& box, const ray& r, interval t) { return box.hit(r, t); }, hits);
+
+    double tests = double(boxes.size()) * rays.size();
+    std::printf("%.0f testes raio-caixa, %ld acertos (antigo) e %ld acertos (atual)\n",
+                tests, legacy_hits, hits);
+    std::printf("antigo: %7.1f milhões de testes/s\n", tests / legacy / 1e6);
+    std::printf("atual:  %7.1f milhões de testes/s (%.2fx)\n", tests / current / 1e6,
+                legacy / current);
+
+    return 0;
+}
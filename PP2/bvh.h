@@ -16,43 +16,153 @@
 #include "hittable_list.h"
 
 #include <algorithm>
+#include <chrono>
+#include <vector>
+
+
+enum class bvh_split_method {
+    median,  // Sort along the longest axis and split at the object-count median
+    sah      // Binned surface area heuristic
+};
+
+
+class bvh_build_options {
+  public:
+    bvh_split_method split = bvh_split_method::median;
+
+    int    sah_bins          = 16;     // Centroid bins evaluated per axis by the SAH builder
+    double traversal_cost    = 0.125;  // Cost of visiting a node, relative to...
+    double intersection_cost = 1.0;    // ...the cost of testing one primitive
+
+    // Primitives a leaf tests together in one SIMD packet. The flattened BVH charges a leaf one
+    // intersection per packet rather than per primitive, so it settles for fuller leaves.
+    int    packet_width      = 1;
+};
+
+
+template <typename T, typename BoxOf>
+size_t sah_partition(
+    std::vector<T>& items, size_t start, size_t end, const aabb& bbox, BoxOf box_of,
+    const bvh_build_options& options, double& split_cost
+) {
+    // Finds the best binned surface area heuristic split of items[start, end), whose bounding
+    // box is bbox and whose individual boxes are given by box_of(item). The items are
+    // partitioned in place and the split index is returned, along with the estimated SAH cost
+    // of the split in split_cost. Returns start, leaving the items untouched, if their
+    // centroids cannot be separated.
+
+    auto centroid = [&](const T& item, int axis) {
+        auto ax = box_of(item).axis_interval(axis);
+        return 0.5 * (ax.min + ax.max);
+    };
+
+    struct bin {
+        aabb bbox = aabb::empty;
+        size_t count = 0;
+    };
+
+    int bin_count = std::max(2, options.sah_bins);
+    std::vector<bin> bins(bin_count);
+    std::vector<double> area_right(bin_count);
+    std::vector<size_t> count_right(bin_count);
+
+    auto node_area = bbox.surface_area();
+    int best_axis = -1;
+    int best_bin = 0;
+    double best_min = 0, best_scale = 0;
+    split_cost = infinity;
+
+    for (int axis = 0; axis < 3; axis++) {
+        auto cmin = +infinity, cmax = -infinity;
+        for (size_t i = start; i < end; i++) {
+            auto c = centroid(items[i], axis);
+            cmin = std::fmin(cmin, c);
+            cmax = std::fmax(cmax, c);
+        }
+        if (!(cmax > cmin))
+            continue;
+
+        auto scale = bin_count / (cmax - cmin);
+
+        for (auto& b : bins)
+            b = bin();
+        for (size_t i = start; i < end; i++) {
+            auto index = std::min(bin_count - 1, int((centroid(items[i], axis) - cmin) * scale));
+            bins[index].bbox = aabb(bins[index].bbox, box_of(items[i]));
+            bins[index].count++;
+        }
+
+        // Sweep from the right to get the area and count to the right of every bin boundary,
+        // then from the left to evaluate each split.
+        auto right = aabb::empty;
+        size_t count = 0;
+        for (int i = bin_count - 1; i > 0; i--) {
+            right = aabb(right, bins[i].bbox);
+            count += bins[i].count;
+            area_right[i] = right.surface_area();
+            count_right[i] = count;
+        }
+
+        auto left = aabb::empty;
+        count = 0;
+        for (int i = 0; i < bin_count - 1; i++) {
+            left = aabb(left, bins[i].bbox);
+            count += bins[i].count;
+            if (count == 0 || count_right[i+1] == 0)
+                continue;
+
+            auto cost = options.traversal_cost + options.intersection_cost
+                      * (left.surface_area()*count + area_right[i+1]*count_right[i+1])
+                      / node_area;
+
+            if (cost < split_cost) {
+                split_cost = cost;
+                best_axis = axis;
+                best_bin = i;
+                best_min = cmin;
+                best_scale = scale;
+            }
+        }
+    }
+
+    if (best_axis < 0)
+        return start;
+
+    auto middle = std::partition(
+        std::begin(items) + start, std::begin(items) + end,
+        [&](const T& item) {
+            auto index = std::min(bin_count - 1,
+                                  int((centroid(item, best_axis) - best_min) * best_scale));
+            return index <= best_bin;
+        });
+
+    return size_t(middle - std::begin(items));
+}
 
 
 class bvh_node : public hittable {
   public:
-    bvh_node(hittable_list list) : bvh_node(list.objects, 0, list.objects.size()) {
+    bvh_node(hittable_list list, const bvh_build_options& options = bvh_build_options()) {
         // There's a C++ subtlety here. This constructor (without span indices) creates an
         // implicit copy of the hittable list, which we will modify. The lifetime of the copied
         // list only extends until this constructor exits. That's OK, because we only need to
         // persist the resulting bounding volume hierarchy.
-    }
-
-    bvh_node(std::vector<shared_ptr<hittable>>& objects, size_t start, size_t end) {
-        // Build the bounding box of the span of source objects.
-        bbox = aabb::empty;
-        for (size_t object_index=start; object_index < end; object_index++)
-            bbox = aabb(bbox, objects[object_index]->bounding_box());
-
-        int axis = bbox.longest_axis();
-
-        auto comparator = (axis == 0) ? box_x_compare
-                        : (axis == 1) ? box_y_compare
-                                      : box_z_compare;
 
-        size_t object_span = end - start;
+        auto start_time = std::chrono::steady_clock::now();
+        build(list.objects, 0, list.objects.size(), options);
+        std::chrono::duration<double, std::milli> elapsed =
+            std::chrono::steady_clock::now() - start_time;
 
-        if (object_span == 1) {
-            left = right = objects[start];
-        } else if (object_span == 2) {
-            left = objects[start];
-            right = objects[start+1];
-        } else {
-            std::sort(std::begin(objects) + start, std::begin(objects) + end, comparator);
+        std::clog << "BVH (" << (options.split == bvh_split_method::sah ? "SAH" : "median")
+                  << "): " << list.objects.size() << " objects, SAH cost " << sah_cost
+                  << ", built in " << elapsed.count() << " ms\n";
+    }
 
-            auto mid = start + object_span/2;
-            left = make_shared<bvh_node>(objects, start, mid);
-            right = make_shared<bvh_node>(objects, mid, end);
-        }
+    bvh_node(
+        std::vector<shared_ptr<hittable>>& objects, size_t start, size_t end,
+        const bvh_build_options& options = bvh_build_options()
+    ) {
+        build(objects, start, end, options);
     }
 
     bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
@@ -65,12 +175,81 @@ class bvh_node : public hittable {
         return hit_left || hit_right;
     }
 
+    bool occluded(const ray& r, interval ray_t) const override {
+        return bbox.hit(r, ray_t) && (left->occluded(r, ray_t) || right->occluded(r, ray_t));
+    }
+
     aabb bounding_box() const override { return bbox; }
 
+    // Expected cost of a ray query against this subtree under the surface area heuristic,
+    // using the cost constants the tree was built with.
+    double cost() const { return sah_cost; }
+
   private:
     shared_ptr<hittable> left;
     shared_ptr<hittable> right;
     aabb bbox;
+    double sah_cost;
+
+    void build(
+        std::vector<shared_ptr<hittable>>& objects, size_t start, size_t end,
+        const bvh_build_options& options
+    ) {
+        // Build the bounding box of the span of source objects.
+        bbox = aabb::empty;
+        for (size_t object_index=start; object_index < end; object_index++)
+            bbox = aabb(bbox, objects[object_index]->bounding_box());
+
+        size_t object_span = end - start;
+        double left_cost = options.intersection_cost;
+        double right_cost = options.intersection_cost;
+
+        if (object_span == 1) {
+            left = right = objects[start];
+        } else if (object_span == 2) {
+            left = objects[start];
+            right = objects[start+1];
+        } else {
+            size_t mid = start;
+
+            if (options.split == bvh_split_method::sah) {
+                double split_cost;
+                mid = sah_partition(
+                    objects, start, end, bbox,
+                    [](const shared_ptr<hittable>& object) { return object->bounding_box(); },
+                    options, split_cost);
+            }
+
+            if (mid == start) {
+                int axis = bbox.longest_axis();
+
+                auto comparator = (axis == 0) ? box_x_compare
+                                : (axis == 1) ? box_y_compare
+                                              : box_z_compare;
+
+                std::sort(std::begin(objects) + start, std::begin(objects) + end, comparator);
+                mid = start + object_span/2;
+            }
+
+            auto left_node = make_shared<bvh_node>(objects, start, mid, options);
+            auto right_node = make_shared<bvh_node>(objects, mid, end, options);
+            left_cost = left_node->cost();
+            right_cost = right_node->cost();
+            left = left_node;
+            right = right_node;
+        }
+
+        // Both children are visited whenever this node's box is hit, each with a probability
+        // proportional to its own surface area.
+        auto area = bbox.surface_area();
+        sah_cost = options.traversal_cost;
+        if (area > 0) {
+            sah_cost += left->bounding_box().surface_area() / area * left_cost
+                      + right->bounding_box().surface_area() / area * right_cost;
+        } else {
+            sah_cost += left_cost + right_cost;
+        }
+    }
 
     static bool box_compare(
         const shared_ptr<hittable> a, const shared_ptr<hittable> b, int axis_index
@@ -11,8 +11,38 @@
 // along with this software. If not, see <http://creativecommons.org/publicdomain/zero/1.0/>.
 //==============================================================================================
 
+#include "denoiser.h"
+#include "environment.h"
+#include "framebuffer.h"
 #include "hittable.h"
+#include "light_list.h"
 #include "material.h"
+#include "sampler.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+enum class integrator_method {
+    path_tracing,  // Lights are only found by scattered rays that happen to hit them
+    next_event,    // Non-specular hits also sample a point on a light and cast a shadow ray
+    mis            // Both, with multiple importance sampling weights (power heuristic)
+};
+
+
+enum class sampler_method {
+    independent,  // Every random number drawn independently
+    stratified,   // Jittered strata in each dimension, shuffled per dimension
+    halton,       // Halton sequence with randomly permuted digits
+    sobol         // Owen-scrambled Sobol sequence
+};
 
 
 class camera {
@@ -23,6 +53,64 @@ class camera {
     int    max_depth         = 10;   // Maximum number of ray bounces into scene
     color  background;               // Scene background color
 
+    // Light from an HDR sky image, seen by rays that escape the scene in place of background.
+    // With next event estimation or MIS it is also sampled directly, like the scene's lights.
+    shared_ptr<environment_map> environment;
+
+    // Russian roulette: after roulette_min_depth bounces, a path survives each further bounce
+    // with a probability that follows its throughput, and survivors are reweighted to keep
+    // the estimate unbiased. max_depth remains a hard cap.
+    bool russian_roulette   = true;
+    int  roulette_min_depth = 3;
+
+    // How light sources are found. For next event estimation or MIS, pass the scene's lights
+    // to render(world, lights), as a light_list or, for scenes with many lights, a light_bvh;
+    // every hit on a non-specular material then samples one of them.
+    integrator_method integrator = integrator_method::path_tracing;
+
+    // Where the random numbers of each sample come from. With anything but independent, the
+    // decisions along a path (pixel position, lens position, time, and at each bounce the
+    // light pick, light point, environment point, scattering direction and Russian roulette)
+    // each draw from their own dimension of a sequence that spreads the pixel's samples
+    // evenly, which lowers noise at a given samples_per_pixel.
+    sampler_method sampling = sampler_method::independent;
+
+    int threads   = int(std::thread::hardware_concurrency());  // Render worker thread count
+    int tile_size = 16;                                         // Render tile edge, in pixels
+    unsigned long rng_seed = 0;  // Base seed; a frame is reproducible for a given seed
+
+    // Image file written after rendering (.png, .ppm, .pfm or .hdr). When empty, the image is
+    // written to std::cout as a plain-text PPM.
+    std::string output_file;
+
+    // Progressive rendering. The image is built up in passes of samples_per_pass samples per
+    // pixel (0 renders all samples_per_pixel in a single pass). If checkpoint_file is set, the
+    // accumulated samples are saved there every checkpoint_interval passes, and with resume
+    // set a later render() continues from that file up to samples_per_pixel. Resuming takes
+    // the same image size, seed, sampling method and samples_per_pixel as the saved render.
+    int         samples_per_pass    = 0;
+    int         checkpoint_interval = 1;
+    std::string checkpoint_file;
+    bool        resume = false;
+
+    // Adaptive sampling. Once a pixel has adaptive_min_samples samples, it stops sampling as
+    // soon as the estimated error of its displayed (gamma 2) luminance drops below
+    // adaptive_threshold; samples_per_pixel becomes the upper bound. The number of samples
+    // each pixel received is written as a heatmap to sample_heatmap_file, if set.
+    bool        adaptive_sampling    = false;
+    double      adaptive_threshold   = 0.01;
+    int         adaptive_min_samples = 16;
+    std::string sample_heatmap_file;
+
+    // Denoising. After the last pass, the image is smoothed by an edge-avoiding filter guided
+    // by the albedo, normal and distance that each pixel's camera rays found (past any mirrors
+    // and glass), so that a few samples per pixel give a clean image. denoise_strength is the
+    // luminance difference the filter smooths over, in standard deviations of a pixel's noise.
+    // Images written before the last pass are not denoised.
+    bool   denoise            = false;
+    int    denoise_iterations = 5;
+    double denoise_strength   = 4;
+
     double vfov     = 90;              // Vertical view angle (field of view)
     point3 lookfrom = point3(0,0,0);   // Point camera is looking from
     point3 lookat   = point3(0,0,-1);  // Point camera is looking at
@@ -32,28 +120,81 @@ class camera {
     double focus_dist = 10;    // Distance from camera lookfrom point to plane of perfect focus
 
     void render(const hittable& world) {
-        initialize();
+        render(world, light_list());
+    }
 
-        std::cout << "P3\n" << image_width << ' ' << image_height << "\n255\n";
+    void render(const hittable& world, const light_sampler& lights) {
+        initialize();
 
-        for (int j = 0; j < image_height; j++) {
-            std::clog << "\rScanlines remaining: " << (image_height - j) << ' ' << std::flush;
-            for (int i = 0; i < image_width; i++) {
-                color pixel_color(0,0,0);
-                for (int sample = 0; sample < samples_per_pixel; sample++) {
-                    ray r = get_ray(i, j);
-                    pixel_color += ray_color(r, max_depth, world);
-                }
-                write_color(std::cout, pixel_samples_scale * pixel_color);
+        // The frame is rendered in passes of samples_per_pass samples per pixel, summed into a
+        // persistent accumulation buffer. With a checkpoint file, the buffer and per-pixel
+        // sample counts are saved after every checkpoint_interval passes; because each
+        // sample's random stream is seeded from its pixel and sample index, resuming from a
+        // checkpoint produces exactly the image an uninterrupted render would have.
+
+        auto pixel_count = size_t(image_width) * image_height;
+        accum = framebuffer(image_width, image_height);
+        accum_sq.assign(pixel_count, 0.0);
+        total_paths = total_bounces = 0;
+        pixel_samples.assign(pixel_count, 0);
+        albedo_accum = normal_accum = framebuffer(denoise ? image_width : 0,
+                                                  denoise ? image_height : 0);
+        depth_accum.assign(denoise ? pixel_count : 0, 0.0f);
+
+        if (resume && !checkpoint_file.empty() && load_checkpoint())
+            std::clog << "Resuming from '" << checkpoint_file << "'.\n";
+
+        int pass_size = (samples_per_pass > 0)  ? samples_per_pass
+                      : adaptive_sampling       ? adaptive_min_samples
+                                                : samples_per_pixel;
+        int pass = 0;
+        int pixels_left = count_unfinished_pixels();
+
+        while (pixels_left > 0) {
+            pass++;
+            pixels_left = render_pass(world, lights, pass, pass_size);
+
+            bool finished = (pixels_left == 0);
+            if (!checkpoint_file.empty() && (finished || pass % checkpoint_interval == 0))
+                save_checkpoint();
+
+            // Keep an up-to-date image on disk so a long render can be stopped at any time.
+            if (!finished && !output_file.empty()) {
+                resolve();
+                write_output();
             }
         }
 
-        std::clog << "\rDone.                 \n";
+        resolve();
+        std::clog << "\rDone.                                                  \n";
+
+        if (denoise)
+            image = denoised_image();
+
+        if (total_paths > 0)
+            std::clog << "Average path length: " << double(total_bounces) / total_paths
+                      << " bounces over " << total_paths << " paths.\n";
+
+        if (adaptive_sampling)
+            report_sample_counts();
+        if (!sample_heatmap_file.empty())
+            sample_heatmap().write(sample_heatmap_file);
+
+        write_output();
+    }
+
+    const framebuffer& rendered_image() const { return image; }
+
+    void write_output() const {
+        // Writes the last rendered image to output_file, or to std::cout if there is none.
+        if (output_file.empty())
+            image.write_p3(std::cout);
+        else
+            image.write(output_file);
     }
 
   private:
     int    image_height;         // Rendered image height
-    double pixel_samples_scale;  // Color scale factor for a sum of pixel samples
     point3 center;               // Camera center
     point3 pixel00_loc;          // Location of pixel 0, 0
     vec3   pixel_delta_u;        // Offset to pixel to the right
@@ -61,12 +202,68 @@ class camera {
     vec3   u, v, w;              // Camera frame basis vectors
     vec3   defocus_disk_u;       // Defocus disk horizontal radius
     vec3   defocus_disk_v;       // Defocus disk vertical radius
+    shared_ptr<thread_pool> pool;  // Render workers, kept alive across calls to render()
+    framebuffer image;             // Linear color of the last rendered frame
+    framebuffer accum;             // Per-pixel sum of all samples taken so far
+    std::vector<double> accum_sq;  // Per-pixel sum of squared sample luminance
+    std::vector<int> pixel_samples;  // Per-pixel count of samples taken so far
+    long long total_paths;         // Paths traced by the current render() call
+    long long total_bounces;       // Scattering events along those paths
+    shared_ptr<sampler> sample_source;  // Sequence behind the sampling method, if any
+    framebuffer albedo_accum;      // Per-pixel sums of the denoising features, when denoising
+    framebuffer normal_accum;
+    std::vector<float> depth_accum;
+
+    // What a camera ray found at its first hit that isn't a mirror or glass, for denoising.
+    struct pixel_features {
+        color  albedo;  // Surface color, times the color of the mirrors and glass on the way
+        vec3   normal;  // Unit normal facing the ray; zero for the sky and for media
+        double depth;   // Path length from the camera
+    };
+
+    // Sample dimensions of each path: the camera ray's, then a block for each bounce. Pairs
+    // that are used together as a 2D point start at even dimensions.
+    enum : unsigned {
+        pixel_dimension = 0,       // 2D offset within the pixel
+        lens_dimension = 2,        // 2D point on the defocus disk
+        time_dimension = 4,
+        first_bounce_dimension = 6,
+
+        // Offsets within a bounce's block
+        scatter_dimension = 0,     // 2D scattering direction (dielectrics use one)
+        light_point_dimension = 2, // 2D point on the picked light
+        sky_dimension = 4,         // 2D point within the picked pixel, then the pixel pick
+        light_pick_dimension = 7,
+        roulette_dimension = 8,
+        bounce_dimensions = 10
+    };
 
     void initialize() {
         image_height = int(image_width / aspect_ratio);
         image_height = (image_height < 1) ? 1 : image_height;
 
-        pixel_samples_scale = 1.0 / samples_per_pixel;
+        threads = (threads < 1) ? 1 : threads;
+        tile_size = (tile_size < 1) ? 1 : tile_size;
+        if (!pool || pool->size() != threads)
+            pool = make_shared<thread_pool>(threads);
+
+        checkpoint_interval = (checkpoint_interval < 1) ? 1 : checkpoint_interval;
+        adaptive_min_samples = (adaptive_min_samples < 1) ? 1 : adaptive_min_samples;
+
+        switch (sampling) {
+            case sampler_method::independent:
+                sample_source = nullptr;
+                break;
+            case sampler_method::stratified:
+                sample_source = make_shared<stratified_sampler>(samples_per_pixel, rng_seed);
+                break;
+            case sampler_method::halton:
+                sample_source = make_shared<halton_sampler>(rng_seed);
+                break;
+            case sampler_method::sobol:
+                sample_source = make_shared<sobol_sampler>(rng_seed);
+                break;
+        }
 
         center = lookfrom;
 
@@ -99,25 +296,336 @@ class camera {
         defocus_disk_v = v * defocus_radius;
     }
 
+    int render_pass(const hittable& world, const light_sampler& lights, int pass, int pass_size) {
+        // Adds up to pass_size samples to every pixel that still needs them, and returns the
+        // number of pixels that need more afterwards. The image is split into tiles for the
+        // worker pool; tile costs vary wildly (open sky versus textured geometry, or converged
+        // versus noisy pixels), which the pool's work stealing evens out.
+
+        int tiles_x = (image_width  + tile_size - 1) / tile_size;
+        int tiles_y = (image_height + tile_size - 1) / tile_size;
+        int tile_count = tiles_x * tiles_y;
+        int tiles_done = 0;
+        int pixels_left = 0;
+        std::mutex progress_mutex;
+
+        pool->run(tile_count, [&](int tile, int) {
+            int x0 = (tile % tiles_x) * tile_size;
+            int y0 = (tile / tiles_x) * tile_size;
+            int x1 = std::min(x0 + tile_size, image_width);
+            int y1 = std::min(y0 + tile_size, image_height);
+            int tile_pixels_left = 0;
+            long long tile_paths = 0, tile_bounces = 0;
+
+            for (int j = y0; j < y1; j++) {
+                for (int i = x0; i < x1; i++) {
+                    auto index = size_t(j)*image_width + i;
+                    if (!needs_samples(index))
+                        continue;
+
+                    int first_sample = pixel_samples[index];
+                    int end_sample = std::min(first_sample + pass_size, samples_per_pixel);
+
+                    color pixel_color(0,0,0);
+                    double luminance_sq = 0;
+                    pixel_features features, feature_sum{color(0,0,0), vec3(0,0,0), 0};
+                    for (int sample = first_sample; sample < end_sample; sample++) {
+                        seed_thread_rng(rng_seed, index, sample);
+                        begin_sample_stream(sample_source.get(), index, sample);
+                        ray r = get_ray(i, j);
+                        int bounces;
+                        auto sample_color = ray_color(r, world, lights, bounces,
+                                                      denoise ? &features : nullptr);
+                        auto l = luminance(sample_color);
+                        pixel_color += sample_color;
+                        luminance_sq += l*l;
+                        tile_bounces += bounces;
+
+                        if (denoise) {
+                            feature_sum.albedo += features.albedo;
+                            feature_sum.normal += features.normal;
+                            feature_sum.depth += features.depth;
+                        }
+                    }
+                    tile_paths += end_sample - first_sample;
+
+                    accum.set(i, j, accum.get(i, j) + pixel_color);
+                    if (denoise) {
+                        albedo_accum.set(i, j, albedo_accum.get(i, j) + feature_sum.albedo);
+                        normal_accum.set(i, j, normal_accum.get(i, j) + feature_sum.normal);
+                        depth_accum[index] += float(feature_sum.depth);
+                    }
+                    accum_sq[index] += luminance_sq;
+                    pixel_samples[index] = end_sample;
+
+                    if (needs_samples(index))
+                        tile_pixels_left++;
+                }
+            }
+
+            std::lock_guard<std::mutex> lock(progress_mutex);
+            tiles_done++;
+            pixels_left += tile_pixels_left;
+            total_paths += tile_paths;
+            total_bounces += tile_bounces;
+            std::clog << "\rPass " << pass << ", tiles remaining: " << (tile_count - tiles_done)
+                      << ' ' << std::flush;
+        });
+
+        return pixels_left;
+    }
+
+    static double luminance(const color& c) {
+        return 0.2126*c.x() + 0.7152*c.y() + 0.0722*c.z();
+    }
+
+    bool needs_samples(size_t index) const {
+        // Returns true if the pixel should receive more samples.
+
+        int n = pixel_samples[index];
+        if (n >= samples_per_pixel)
+            return false;
+        if (!adaptive_sampling || n < adaptive_min_samples || n < 2)
+            return true;
+
+        // Standard error of the pixel's mean luminance, from its running sum and sum of
+        // squares. The output is gamma 2 (a square root), so an error e around mean m shows
+        // up on screen as roughly e / (2 sqrt(m)); that is the value held to the threshold.
+        auto x = accum.pixels() + 3*index;
+        auto mean = luminance(color(x[0], x[1], x[2])) / n;
+        auto variance = std::fmax(0.0, (accum_sq[index] / n - mean*mean) * n / (n - 1));
+        auto std_error = std::sqrt(variance / n);
+        auto display_error = std_error / (2 * std::sqrt(std::fmax(mean, 1e-4)));
+
+        return display_error > adaptive_threshold;
+    }
+
+    int count_unfinished_pixels() const {
+        int count = 0;
+        for (size_t index = 0; index < pixel_samples.size(); index++)
+            if (needs_samples(index))
+                count++;
+        return count;
+    }
+
+    void resolve() {
+        // Averages each pixel's accumulated samples into the output image.
+        image = framebuffer(image_width, image_height);
+
+        const float* in = accum.pixels();
+        float* out = image.pixels();
+        for (size_t index = 0; index < pixel_samples.size(); index++) {
+            if (pixel_samples[index] <= 0)
+                continue;
+            float scale = 1.0f / pixel_samples[index];
+            for (int c = 0; c < 3; c++)
+                out[3*index + c] = scale * in[3*index + c];
+        }
+    }
+
+    framebuffer denoised_image() const {
+        // Filters the resolved image, guided by the pixels' mean features. The filter weighs
+        // luminance differences against the noise of each pixel's mean, estimated from its
+        // samples like adaptive sampling does; a pixel with a single sample is taken to be
+        // as noisy as it is bright.
+        auto count = pixel_samples.size();
+        framebuffer albedo(image_width, image_height), normal(image_width, image_height);
+        std::vector<float> depth(count), variance(count);
+
+        for (size_t index = 0; index < count; index++) {
+            int n = pixel_samples[index];
+            if (n <= 0)
+                continue;
+
+            float scale = 1.0f / n;
+            for (int c = 0; c < 3; c++) {
+                albedo.pixels()[3*index + c] = scale * albedo_accum.pixels()[3*index + c];
+                normal.pixels()[3*index + c] = scale * normal_accum.pixels()[3*index + c];
+            }
+            depth[index] = scale * depth_accum[index];
+
+            auto x = image.pixels() + 3*index;
+            auto mean = luminance(color(x[0], x[1], x[2]));
+            variance[index] = float((n < 2) ? mean*mean
+                : std::fmax(0.0, (accum_sq[index] / n - mean*mean) / (n - 1)));
+        }
+
+        denoiser filter;
+        filter.iterations = denoise_iterations;
+        filter.color_phi = denoise_strength;
+        return filter.filter(image, variance, albedo, normal, depth, *pool);
+    }
+
+    void report_sample_counts() const {
+        long long total = 0;
+        int fewest = samples_per_pixel, most = 0;
+        for (auto n : pixel_samples) {
+            total += n;
+            fewest = std::min(fewest, n);
+            most = std::max(most, n);
+        }
+
+        std::clog << "Adaptive sampling: " << double(total) / pixel_samples.size()
+                  << " samples per pixel on average (min " << fewest << ", max " << most
+                  << ", budget " << samples_per_pixel << ").\n";
+    }
+
+    framebuffer sample_heatmap() const {
+        // Visualizes where the sample budget went: blue pixels received few samples, through
+        // green, to red pixels that used the full samples_per_pixel.
+
+        framebuffer heatmap(image_width, image_height);
+        for (int j = 0; j < image_height; j++) {
+            for (int i = 0; i < image_width; i++) {
+                auto t = double(pixel_samples[size_t(j)*image_width + i]) / samples_per_pixel;
+                auto c = color(
+                    interval(0,1).clamp(2*t - 1),
+                    1 - std::fabs(2*t - 1),
+                    interval(0,1).clamp(1 - 2*t)
+                );
+                heatmap.set(i, j, c*c);  // Squared to undo the gamma applied on output
+            }
+        }
+        return heatmap;
+    }
+
+    // Checkpoint layout: magic, image width and height, whether denoising features follow, the
+    // sampling method and samples per pixel (which together fix the sample sequences) and the
+    // RNG seed, followed by the float accumulation buffer, the per-pixel luminance sums of
+    // squares and the per-pixel sample counts, then, when denoising, the float sums of albedo,
+    // normal and depth.
+    static constexpr char checkpoint_magic[8] = {'R','T','W','A','C','C','4','\0'};
+
+    void save_checkpoint() const {
+        // Writes to a temporary file first, so a crash mid-write never destroys the previous
+        // checkpoint.
+
+        auto temp_file = checkpoint_file + ".tmp";
+        auto file = std::fopen(temp_file.c_str(), "wb");
+        if (!file) {
+            std::cerr << "ERROR: Could not write checkpoint file '" << temp_file << "'.\n";
+            return;
+        }
+
+        int32_t header[5] = {
+            image_width, image_height, denoise, int32_t(sampling), samples_per_pixel
+        };
+        uint64_t seed = rng_seed;
+        size_t count = pixel_samples.size();
+
+        bool ok = std::fwrite(checkpoint_magic, sizeof(checkpoint_magic), 1, file) == 1
+               && std::fwrite(header, sizeof(header), 1, file) == 1
+               && std::fwrite(&seed, sizeof(seed), 1, file) == 1
+               && std::fwrite(accum.pixels(), sizeof(float), 3*count, file) == 3*count
+               && std::fwrite(accum_sq.data(), sizeof(double), count, file) == count
+               && std::fwrite(pixel_samples.data(), sizeof(int32_t), count, file) == count;
+        if (denoise) {
+            ok = ok
+              && std::fwrite(albedo_accum.pixels(), sizeof(float), 3*count, file) == 3*count
+              && std::fwrite(normal_accum.pixels(), sizeof(float), 3*count, file) == 3*count
+              && std::fwrite(depth_accum.data(), sizeof(float), count, file) == count;
+        }
+        ok = (std::fclose(file) == 0) && ok;
+
+        if (ok && std::rename(temp_file.c_str(), checkpoint_file.c_str()) != 0) {
+            std::remove(checkpoint_file.c_str());
+            ok = std::rename(temp_file.c_str(), checkpoint_file.c_str()) == 0;
+        }
+
+        if (!ok)
+            std::cerr << "ERROR: Could not write checkpoint file '" << checkpoint_file << "'.\n";
+    }
+
+    bool load_checkpoint() {
+        // Restores the accumulation state from checkpoint_file. Returns false, leaving the
+        // state untouched, if there is no checkpoint or it belongs to a different render. A
+        // render with denoising needs the features of the samples already taken, so it can't
+        // resume from a checkpoint saved without them.
+
+        auto file = std::fopen(checkpoint_file.c_str(), "rb");
+        if (!file)
+            return false;
+
+        char magic[sizeof(checkpoint_magic)];
+        int32_t header[5];
+        uint64_t seed;
+
+        bool ok = std::fread(magic, sizeof(magic), 1, file) == 1
+               && std::memcmp(magic, checkpoint_magic, sizeof(magic)) == 0
+               && std::fread(header, sizeof(header), 1, file) == 1
+               && std::fread(&seed, sizeof(seed), 1, file) == 1
+               && header[0] == image_width && header[1] == image_height
+               && (header[2] != 0 || !denoise)
+               && header[3] == int32_t(sampling) && header[4] == samples_per_pixel
+               && seed == uint64_t(rng_seed);
+
+        if (ok) {
+            size_t count = pixel_samples.size();
+            framebuffer loaded(image_width, image_height);
+            std::vector<double> loaded_sq(count);
+            std::vector<int32_t> loaded_samples(count);
+
+            framebuffer loaded_albedo, loaded_normal;
+            std::vector<float> loaded_depth;
+
+            ok = std::fread(loaded.pixels(), sizeof(float), 3*count, file) == 3*count
+              && std::fread(loaded_sq.data(), sizeof(double), count, file) == count
+              && std::fread(loaded_samples.data(), sizeof(int32_t), count, file) == count;
+
+            if (ok && denoise) {
+                loaded_albedo = loaded_normal = framebuffer(image_width, image_height);
+                loaded_depth.resize(count);
+                ok = std::fread(loaded_albedo.pixels(), sizeof(float), 3*count, file) == 3*count
+                  && std::fread(loaded_normal.pixels(), sizeof(float), 3*count, file) == 3*count
+                  && std::fread(loaded_depth.data(), sizeof(float), count, file) == count;
+            }
+
+            if (ok) {
+                accum = loaded;
+                accum_sq = loaded_sq;
+                pixel_samples.assign(loaded_samples.begin(), loaded_samples.end());
+                if (denoise) {
+                    albedo_accum = loaded_albedo;
+                    normal_accum = loaded_normal;
+                    depth_accum = loaded_depth;
+                }
+            }
+        }
+
+        std::fclose(file);
+
+        if (!ok)
+            std::cerr << "WARNING: Ignoring checkpoint '" << checkpoint_file
+                      << "', which does not match this render.\n";
+        return ok;
+    }
+
     ray get_ray(int i, int j) const {
         // Construct a camera ray originating from the defocus disk and directed at a randomly
         // sampled point around the pixel location i, j.
 
+        set_sample_dimensions(pixel_dimension, 2);
         auto offset = sample_square();
         auto pixel_sample = pixel00_loc
                           + ((i + offset.x()) * pixel_delta_u)
                           + ((j + offset.y()) * pixel_delta_v);
 
+        set_sample_dimensions(lens_dimension, 2);
         auto ray_origin = (defocus_angle <= 0) ? center : defocus_disk_sample();
         auto ray_direction = pixel_sample - ray_origin;
+
+        set_sample_dimensions(time_dimension, 1);
         auto ray_time = random_double();
+        set_sample_dimensions(0, 0);
 
         return ray(ray_origin, ray_direction, ray_time);
     }
 
     vec3 sample_square() const {
         // Returns the vector to a random point in the [-.5,-.5]-[+.5,+.5] unit square.
-        return vec3(random_double() - 0.5, random_double() - 0.5, 0);
+        double xy[2];
+        random_doubles(xy, 2);
+        return vec3(xy[0] - 0.5, xy[1] - 0.5, 0);
     }
 
     vec3 sample_disk(double radius) const {
@@ -131,27 +639,181 @@ class camera {
         return center + (p[0] * defocus_disk_u) + (p[1] * defocus_disk_v);
     }
 
-    color ray_color(const ray& r, int depth, const hittable& world) const {
-        // If we've exceeded the ray bounce limit, no more light is gathered.
-        if (depth <= 0)
+    color ray_color(
+        const ray& r, const hittable& world, const light_sampler& lights, int& bounces,
+        pixel_features* features = nullptr
+    ) const {
+        // Traces a path starting with ray r and returns the light it gathers. The path is
+        // followed iteratively, carrying the product of the attenuations so far (the path
+        // throughput), and bounces is set to the number of surfaces it scattered off. If
+        // features is given, it receives what the path found for the denoiser.
+
+        if (features)
+            *features = pixel_features{color(1,1,1), vec3(0,0,0), 0};
+        double path_length = 0;
+
+        color radiance(0,0,0);
+        color throughput(1,1,1);
+        ray current = r;
+        bounces = 0;
+
+        bool sample_direct = (integrator != integrator_method::path_tracing);
+        bool mis = (integrator == integrator_method::mis);
+        bool lights_sampled = false;  // Whether the previous hit sampled direct light
+        double scatter_pdf = 0;       // Density of the direction the previous hit scattered in
+        vec3 scatter_normal;          // Surface normal at the previous hit
+
+        // Once we've exceeded the ray bounce limit, no more light is gathered.
+        for (int depth = 0; depth < max_depth; depth++) {
+            hit_record rec;
+            auto block = first_bounce_dimension + unsigned(depth) * bounce_dimensions;
+
+            // If the ray hits nothing, it picks up the background color, or the environment
+            // light, which like the scene's lights may already have been sampled directly.
+            if (!world.hit(current, interval(0.001, infinity), rec)) {
+                if (features)
+                    features->albedo = throughput;
+                if (!environment) {
+                    radiance += throughput * background;
+                } else if (!lights_sampled) {
+                    radiance += throughput * environment->value(current.direction());
+                } else if (mis) {
+                    auto sky_pdf = environment->pdf_value(current.direction());
+                    radiance += power_heuristic(scatter_pdf, sky_pdf)
+                              * throughput * environment->value(current.direction());
+                }
+                break;
+            }
+
+            // Light that the previous hit also sampled directly was found by two strategies.
+            // Next event estimation keeps only the light sample; MIS weighs both by how
+            // likely each strategy was to produce this direction. If the light strategy could
+            // not have produced it (from inside a sphere light, say), it is kept whole.
+            if (!lights_sampled || !lights.contains(rec.object)) {
+                radiance += throughput * rec.mat->emitted(rec.u, rec.v, rec.p);
+            } else {
+                auto light_pdf =
+                    lights.probability(current.origin(), scatter_normal, rec.object)
+                    * rec.object->pdf_value(current.origin(), current.direction(),
+                                            current.time());
+                if (light_pdf <= 0)
+                    radiance += throughput * rec.mat->emitted(rec.u, rec.v, rec.p);
+                else if (mis)
+                    radiance += power_heuristic(scatter_pdf, light_pdf)
+                              * throughput * rec.mat->emitted(rec.u, rec.v, rec.p);
+            }
+
+            // The light path sampled here has one more segment than the path so far, so the
+            // last hit allowed by max_depth doesn't sample (path tracing can't reach it either).
+            lights_sampled = sample_direct && !rec.mat->is_specular() && depth + 1 < max_depth;
+            if (lights_sampled && !lights.empty())
+                radiance += throughput * sample_light(current, rec, world, lights, mis, block);
+            if (lights_sampled && environment)
+                radiance += throughput * sample_environment(current, rec, world, mis, block);
+
+            scatter_record srec;
+            set_sample_dimensions(block + scatter_dimension, 2);
+            auto scattered = rec.mat->scatter(current, rec, srec);
+            set_sample_dimensions(0, 0);
+
+            // The denoiser's features come from the first hit that isn't a mirror or glass,
+            // whose reflections and refractions it would otherwise blur.
+            path_length += rec.t * current.direction().length();
+            if (features && (!scattered || !srec.is_specular || depth + 1 == max_depth)) {
+                auto albedo = scattered ? srec.attenuation : color(1,1,1);
+                *features = pixel_features{throughput * albedo, rec.normal, path_length};
+                features = nullptr;
+            }
+
+            if (!scattered)
+                break;
+
+            bounces++;
+            throughput = throughput * srec.attenuation;
+            scatter_pdf = srec.pdf;
+            scatter_normal = rec.normal;
+
+            if (russian_roulette && bounces >= roulette_min_depth) {
+                // Paths that can no longer carry much light are ended early. Dividing the
+                // survivors by their survival probability keeps the expected value unchanged.
+                auto survival = std::fmin(
+                    0.95, std::fmax(throughput.x(), std::fmax(throughput.y(), throughput.z())));
+                set_sample_dimensions(block + roulette_dimension, 1);
+                auto u = random_double();
+                set_sample_dimensions(0, 0);
+                if (u >= survival)
+                    break;
+                throughput /= survival;
+            }
+
+            current = srec.scattered;
+        }
+
+        return radiance;
+    }
+
+    color sample_light(
+        const ray& r_in, const hit_record& rec, const hittable& world,
+        const light_sampler& lights, bool mis, unsigned block
+    ) const {
+        // One-sample estimate of the light reaching the hit directly from the lights: pick a
+        // light and a direction toward it, cast a shadow ray, and divide what arrives by the
+        // probability of those picks. With mis, the result carries the light strategy's weight.
+        // block is the bounce's first sample dimension.
+
+        double pick_probability;
+        set_sample_dimensions(block + light_pick_dimension, 1);
+        auto light = lights.sample(rec.p, rec.normal, pick_probability);
+        set_sample_dimensions(0, 0);
+        if (!light)
             return color(0,0,0);
 
-        hit_record rec;
+        set_sample_dimensions(block + light_point_dimension, 2);
+        auto direction = unit_vector(light->random(rec.p, r_in.time()));
+        set_sample_dimensions(0, 0);
+
+        hit_record light_rec;
+        if (!light->hit(ray(rec.p, direction, r_in.time()), interval(0.001, infinity), light_rec))
+            return color(0,0,0);
 
-        // If the ray hits nothing, return the background color.
-        if (!world.hit(r, interval(0.001, infinity), rec))
-            return background;
+        auto pdf = pick_probability * light->pdf_value(rec.p, direction, r_in.time());
+        auto f = rec.mat->eval(r_in, rec, direction);
+        if (pdf <= 0 || f.near_zero())
+            return color(0,0,0);
 
-        ray scattered;
-        color attenuation;
-        color color_from_emission = rec.mat->emitted(rec.u, rec.v, rec.p);
+        ray shadow(rec.p, direction, r_in.time());
+        if (world.occluded(shadow, interval(0.001, light_rec.t - 0.001)))
+            return color(0,0,0);
 
-        if (!rec.mat->scatter(r, rec, attenuation, scattered))
-            return color_from_emission;
+        auto weight = mis ? power_heuristic(pdf, rec.mat->pdf(r_in, rec, direction)) : 1.0;
+        return weight * f * light_rec.mat->emitted(light_rec.u, light_rec.v, light_rec.p) / pdf;
+    }
 
-        color color_from_scatter = attenuation * ray_color(scattered, depth-1, world);
+    color sample_environment(
+        const ray& r_in, const hit_record& rec, const hittable& world, bool mis, unsigned block
+    ) const {
+        // The same estimate for the environment light, sampled in proportion to its brightness.
+        // Nothing stands beyond the scene, so any hit along the shadow ray blocks it.
+        double pdf;
+        set_sample_dimensions(block + sky_dimension, 3);
+        auto direction = environment->random(pdf);
+        set_sample_dimensions(0, 0);
+        auto f = rec.mat->eval(r_in, rec, direction);
+        if (pdf <= 0 || f.near_zero())
+            return color(0,0,0);
+
+        if (world.occluded(ray(rec.p, direction, r_in.time()), interval(0.001, infinity)))
+            return color(0,0,0);
+
+        auto weight = mis ? power_heuristic(pdf, rec.mat->pdf(r_in, rec, direction)) : 1.0;
+        return weight * f * environment->value(direction) / pdf;
+    }
 
-        return color_from_emission + color_from_scatter;
+    static double power_heuristic(double pdf, double other_pdf) {
+        // Veach's power heuristic (exponent 2): the weight of a sample drawn with density pdf
+        // when another strategy could have drawn it with density other_pdf.
+        auto a = pdf*pdf, b = other_pdf*other_pdf;
+        return (a + b > 0) ? a / (a + b) : 0;
     }
 };
 
@@ -56,15 +56,18 @@ class constant_medium : public hittable {
         rec.t = rec1.t + hit_distance / ray_length;
         rec.p = r.at(rec.t);
 
-        rec.normal = vec3(1,0,0);  // arbitrary
-        rec.front_face = true;     // also arbitrary
+        rec.normal = vec3(0,0,0);  // none, the medium scatters the same way in all directions
+        rec.front_face = true;     // arbitrary
         rec.mat = phase_function;
+        rec.object = this;
 
         return true;
     }
 
     aabb bounding_box() const override { return boundary->bounding_box(); }
 
+    aabb bounding_box_at(double time) const override { return boundary->bounding_box_at(time); }
+
   private:
     shared_ptr<hittable> boundary;
     double neg_inv_density;
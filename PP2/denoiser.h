@@ -0,0 +1,506 @@
+#ifndef DENOISER_H
+#define DENOISER_H
+//==============================================================================================
+// To the extent possible under law, the author(s) have dedicated all copyright and related and
+// neighboring rights to this software to the public domain worldwide. This software is
+// distributed without any warranty.
+//
+// You should have received a copy (see file COPYING.txt) of the CC0 Public Domain Dedication
+// along with this software. If not, see <http://creativecommons.org/publicdomain/zero/1.0/>.
+//==============================================================================================
+
+#include "framebuffer.h"
+#include "simd.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+
+class denoiser {
+  public:
+    // An edge-avoiding a-trous wavelet filter (Dammertz et al., 2010), with the luminance edge
+    // stop scaled by each pixel's estimated noise as in SVGF (Schied et al., 2017). Each
+    // iteration blends a pixel with 5x5 taps spaced twice as far apart as in the previous one,
+    // so a few iterations cover a wide footprint at 25 taps per pixel each. A tap is weighted
+    // down when its normal, depth or luminance differs from the pixel's by more than noise
+    // would explain, which keeps geometric edges and shadow boundaries sharp.
+    //
+    // The features are those seen by the camera rays at their first hit, averaged over each
+    // pixel's samples: surface albedo, normal (zero where rays left the scene or entered a
+    // medium) and distance. Color is divided by albedo before filtering and multiplied back
+    // after, so texture detail is not blurred along with the noise.
+
+    int    iterations = 5;    // Filter passes; the footprint is 4 * 2^iterations - 3 pixels wide
+    double color_phi  = 4;    // Luminance difference tolerated, in standard deviations of noise
+    double normal_phi = 128;  // Sharpness of the normal edge stop
+    double depth_phi  = 1;    // Depth difference tolerated, relative to the local depth slope
+
+    framebuffer filter(
+        const framebuffer& noisy, const std::vector<float>& variance, const framebuffer& albedo,
+        const framebuffer& normal, const std::vector<float>& depth, thread_pool& pool
+    ) const {
+        // Returns the filtered image. variance holds, per pixel, the variance of the estimate
+        // of its mean luminance.
+
+        frame f(noisy.width(), noisy.height());
+
+        f.parallel_rows(pool, [&](int y0, int y1) {
+            for (int y = y0; y < y1; y++)
+                for (int x = 0; x < f.width; x++)
+                    prepare_pixel(f, x, y, noisy, variance, albedo, normal, depth);
+        });
+
+        for (int iteration = 0; iteration < iterations; iteration++) {
+            int step = 1 << iteration;
+            f.parallel_rows(pool, [&](int y0, int y1) {
+                for (int y = y0; y < y1; y++)
+                    filter_row(f, y, step);
+            });
+            std::swap(f.current, f.next);
+        }
+
+        framebuffer result(f.width, f.height);
+        const float* a = albedo.pixels();
+        float* out = result.pixels();
+        f.parallel_rows(pool, [&](int y0, int y1) {
+            for (auto i = size_t(y0)*f.width, end = size_t(y1)*f.width; i < end; i++) {
+                out[3*i]     = f.current.red[i]   * (a[3*i]     + albedo_epsilon);
+                out[3*i + 1] = f.current.green[i] * (a[3*i + 1] + albedo_epsilon);
+                out[3*i + 2] = f.current.blue[i]  * (a[3*i + 2] + albedo_epsilon);
+            }
+        });
+        return result;
+    }
+
+  private:
+    static constexpr float albedo_epsilon = 1e-3f;  // Keeps black albedo from dividing by zero
+    static constexpr int   group_size = 8;          // Pixels filtered side by side
+    static constexpr float boundary_penalty = 100;  // Edge stop between surface and no surface
+
+    // The buffers are kept as separate planes of floats, so that a tap for a group of
+    // neighbouring pixels reads consecutive values from each plane, and the compiler can
+    // vectorize the loops over the group.
+
+    struct signal {
+        // What the iterations filter: demodulated color, its luminance, and the variance of
+        // that luminance.
+        std::vector<float> red, green, blue, luminance, noise;
+
+        signal(size_t count)
+          : red(count), green(count), blue(count), luminance(count), noise(count) {}
+    };
+
+    struct frame {
+        // The working buffers of one call to filter().
+        int width, height;
+        signal current, next;
+        std::vector<float> normal_x, normal_y, normal_z;  // Unit normals, or zero
+        std::vector<float> surface;  // 1 where the pixel has a surface (a nonzero normal)
+        std::vector<float> depth;
+        std::vector<float> slope_x, slope_y;  // Depth change per pixel along x and y
+
+        frame(int width, int height)
+          : width(width), height(height), current(size_t(width) * height),
+            next(current.red.size()), normal_x(next.red.size()), normal_y(normal_x.size()),
+            normal_z(normal_x.size()), surface(normal_x.size()), depth(normal_x.size()),
+            slope_x(normal_x.size()), slope_y(normal_x.size()) {}
+
+        template <typename function>
+        void parallel_rows(thread_pool& pool, const function& work) const {
+            // Runs work(y0, y1) over bands of rows on the worker pool. Taps far across an edge
+            // get weights so small that their products would be denormal numbers, which are
+            // many times slower to compute with, so those are flushed to zero meanwhile.
+            const int band_rows = 16;
+            int bands = (height + band_rows - 1) / band_rows;
+            pool.run(bands, [&](int band, int) {
+              #if RTW_SIMD_X86
+                auto control = _mm_getcsr();
+                _mm_setcsr(control | 0x8040);  // Flush denormal results and inputs to zero
+              #endif
+                work(band * band_rows, std::min((band + 1) * band_rows, height));
+              #if RTW_SIMD_X86
+                _mm_setcsr(control);
+              #endif
+            });
+        }
+    };
+
+    static float luminance(const float* c) {
+        return 0.2126f*c[0] + 0.7152f*c[1] + 0.0722f*c[2];
+    }
+
+    static float exp_negative(float x) {
+        // e^x for x <= 0, to about 3e-4 relative error, which is plenty for filter weights.
+        // Unlike std::exp(), it vectorizes: 2^(x log2 e) is split into a power of two, set
+        // directly in the exponent bits, and a fraction in (-1,0] taken by a polynomial.
+        // Results stop at 2^-60, negligible next to the center tap, which keeps the power of
+        // two in range. Like max_ps in the SIMD versions, the clamp turns NaN into -60.
+        x = std::max(-60.0f, x * 1.44269504f);
+        int32_t whole = int32_t(x);
+        float f = x - float(whole);
+        float p = 1 + f*(0.69314718f + f*(0.24022651f + f*(0.05550411f
+                    + f*(0.00961813f + f*0.00133336f))));
+        int32_t bits = (whole + 127) << 23;
+        float scale;
+        std::memcpy(&scale, &bits, sizeof(scale));
+        return p * scale;
+    }
+
+    static void prepare_pixel(
+        frame& f, int x, int y, const framebuffer& noisy, const std::vector<float>& variance,
+        const framebuffer& albedo, const framebuffer& normal, const std::vector<float>& depth
+    ) {
+        auto index = size_t(y)*f.width + x;
+        auto c = noisy.pixels() + 3*index;
+        auto a = albedo.pixels() + 3*index;
+        auto n = normal.pixels() + 3*index;
+
+        // Demodulate the color, and scale its variance by the same factor (taken on luminance).
+        float demodulated[3];
+        for (int k = 0; k < 3; k++)
+            demodulated[k] = c[k] / (a[k] + albedo_epsilon);
+        auto scale = luminance(a) + albedo_epsilon;
+        f.current.red[index] = demodulated[0];
+        f.current.green[index] = demodulated[1];
+        f.current.blue[index] = demodulated[2];
+        f.current.luminance[index] = luminance(demodulated);
+        f.current.noise[index] = variance[index] / (scale*scale);
+
+        // Averaged normals are shorter where the samples saw different surfaces. Short ones
+        // are dropped, which leaves the pixel to match only other pixels without a surface.
+        auto length = std::sqrt(n[0]*n[0] + n[1]*n[1] + n[2]*n[2]);
+        bool has_surface = (length > 0.5f);
+        f.normal_x[index] = has_surface ? n[0] / length : 0.0f;
+        f.normal_y[index] = has_surface ? n[1] / length : 0.0f;
+        f.normal_z[index] = has_surface ? n[2] / length : 0.0f;
+        f.surface[index] = has_surface ? 1.0f : 0.0f;
+        f.depth[index] = depth[index];
+
+        // The depth slope along each axis, taken on the side that changes least so that a
+        // silhouette edge does not pass for a steep surface.
+        auto slope = [&](int dx, int dy) {
+            float best = INFINITY;
+            for (int side : {-1, 1}) {
+                int sx = x + side*dx, sy = y + side*dy;
+                if (sx >= 0 && sx < f.width && sy >= 0 && sy < f.height)
+                    best = std::min(best, std::fabs(depth[size_t(sy)*f.width + sx]
+                                                     - depth[index]));
+            }
+            return std::isfinite(best) ? best : 0.0f;
+        };
+        f.slope_x[index] = slope(1, 0);
+        f.slope_y[index] = slope(0, 1);
+    }
+
+    void filter_row(frame& f, int y, int step) const {
+        // Groups of pixels whose taps all fall inside the image skip the bounds checks and use
+        // the widest SIMD code path; the pixels near the borders are filtered one at a time.
+        int margin = 2*step;
+        int x = 0;
+        if (y >= margin && y < f.height - margin) {
+            for (; x < margin && x < f.width; x++)
+                filter_pixels<1, true>(f, x, y, step);
+            for (; x + group_size <= f.width - margin; x += group_size)
+                filter_pixels<group_size, false>(f, x, y, step);
+        }
+        for (; x < f.width; x++)
+            filter_pixels<1, true>(f, x, y, step);
+    }
+
+    template <int count>
+    struct group {
+        // The state of filtering count neighbouring pixels: two per-pixel constants of the
+        // edge stops, then the weighted sums over the taps.
+        alignas(32) float luminance_scale[count];
+        alignas(32) float depth_tolerance[count];
+        alignas(32) float red[count] = {}, green[count] = {}, blue[count] = {};
+        alignas(32) float noise[count] = {}, weight[count] = {};
+    };
+
+    static constexpr float kernel[5] = { 1.0f/16, 1.0f/4, 3.0f/8, 1.0f/4, 1.0f/16 };
+
+    template <int count, bool check_bounds>
+    void filter_pixels(frame& f, int x0, int y, int step) const {
+        // Filters the count pixels starting at x0 on row y, with taps step pixels apart.
+        auto center = size_t(y)*f.width + x0;
+        group<count> g;
+
+        // The noise level that luminance differences are measured against, from the variance
+        // blurred over the 3x3 neighbourhood, which is steadier than the pixel's own.
+        float blurred[count] = {}, blur_weight[count] = {};
+        for (int dy = -1; dy <= 1; dy++) {
+            if (check_bounds && (y + dy < 0 || y + dy >= f.height))
+                continue;
+            for (int dx = -1; dx <= 1; dx++) {
+                auto row = center + ptrdiff_t(dy)*f.width + dx;
+                auto w = kernel[dx + 2] * kernel[dy + 2];
+                for (int k = 0; k < count; k++) {
+                    if (check_bounds && (x0 + k + dx < 0 || x0 + k + dx >= f.width))
+                        continue;
+                    blurred[k] += w * f.current.noise[row + k];
+                    blur_weight[k] += w;
+                }
+            }
+        }
+
+        for (int k = 0; k < count; k++) {
+            g.luminance_scale[k] =
+                1 / (float(color_phi) * std::sqrt(blurred[k] / blur_weight[k]) + 1e-6f);
+            g.depth_tolerance[k] = 1e-3f * f.depth[center + k] + 1e-6f;
+        }
+
+        if constexpr (check_bounds || count != group_size) {
+            accumulate_scalar<count, check_bounds>(f, x0, y, step, g);
+        } else {
+            switch (active_simd_level()) {
+              #if RTW_SIMD_AVX2
+                case simd_level::avx2: accumulate_avx2(f, center, step, g); break;
+              #endif
+              #if RTW_SIMD_X86
+                case simd_level::sse2: accumulate_sse2(f, center, step, g); break;
+              #endif
+                default:               accumulate_scalar<count, false>(f, x0, y, step, g);
+            }
+        }
+
+        // The center tap always has weight kernel[2]^2, so the total weight is never zero.
+        auto& out = f.next;
+        for (int k = 0; k < count; k++) {
+            auto p = center + k;
+            out.red[p] = g.red[k] / g.weight[k];
+            out.green[p] = g.green[k] / g.weight[k];
+            out.blue[p] = g.blue[k] / g.weight[k];
+            out.luminance[p] = 0.2126f*out.red[p] + 0.7152f*out.green[p] + 0.0722f*out.blue[p];
+            out.noise[p] = g.noise[k] / (g.weight[k]*g.weight[k]);
+        }
+    }
+
+    // Each lane weighs a tap by all three edge stops in a single exponential. The normal term
+    // approximates dot(n, qn)^normal_phi, and the depth difference is compared to what the
+    // local slope predicts over the distance to the tap. A tap on the other side of a surface's
+    // boundary gets a term large enough to leave it no weight.
+
+    template <int count, bool check_bounds>
+    void accumulate_scalar(const frame& f, int x0, int y, int step, group<count>& g) const {
+        const auto& in = f.current;
+        auto center = size_t(y)*f.width + x0;
+
+        for (int j = -2; j <= 2; j++) {
+            if (check_bounds && (y + j*step < 0 || y + j*step >= f.height))
+                continue;
+
+            for (int i = -2; i <= 2; i++) {
+                auto tap = center + ptrdiff_t(j*step)*f.width + i*step;
+                auto reach_x = float(step * std::abs(i)), reach_y = float(step * std::abs(j));
+                auto tap_weight = kernel[i + 2] * kernel[j + 2];
+
+                for (int k = 0; k < count; k++) {
+                    if (check_bounds && (x0 + k + i*step < 0 || x0 + k + i*step >= f.width))
+                        continue;
+                    auto p = center + k, q = tap + k;
+
+                    auto cos_normals = f.normal_x[p]*f.normal_x[q] + f.normal_y[p]*f.normal_y[q]
+                                     + f.normal_z[p]*f.normal_z[q];
+                    auto normal_term = float(normal_phi) * f.surface[p] * (1 - cos_normals)
+                                     + boundary_penalty * std::fabs(f.surface[p] - f.surface[q]);
+                    auto expected = reach_x * f.slope_x[p] + reach_y * f.slope_y[p];
+                    auto depth_term = std::fabs(f.depth[q] - f.depth[p])
+                                    / (float(depth_phi) * expected + g.depth_tolerance[k]);
+                    auto luminance_term =
+                        std::fabs(in.luminance[q] - in.luminance[p]) * g.luminance_scale[k];
+
+                    auto w = tap_weight
+                           * exp_negative(-(normal_term + depth_term + luminance_term));
+                    g.red[k] += w * in.red[q];
+                    g.green[k] += w * in.green[q];
+                    g.blue[k] += w * in.blue[q];
+                    g.noise[k] += w*w * in.noise[q];
+                    g.weight[k] += w;
+                }
+            }
+        }
+    }
+
+  #if RTW_SIMD_X86
+    static __m128 exp_negative_sse2(__m128 x) {
+        // exp_negative() on four lanes.
+        x = _mm_max_ps(_mm_mul_ps(x, _mm_set1_ps(1.44269504f)), _mm_set1_ps(-60.0f));
+        auto whole = _mm_cvttps_epi32(x);
+        auto f = _mm_sub_ps(x, _mm_cvtepi32_ps(whole));
+        auto p = _mm_add_ps(_mm_set1_ps(0.00961813f), _mm_mul_ps(f, _mm_set1_ps(0.00133336f)));
+        p = _mm_add_ps(_mm_set1_ps(0.05550411f), _mm_mul_ps(f, p));
+        p = _mm_add_ps(_mm_set1_ps(0.24022651f), _mm_mul_ps(f, p));
+        p = _mm_add_ps(_mm_set1_ps(0.69314718f), _mm_mul_ps(f, p));
+        p = _mm_add_ps(_mm_set1_ps(1.0f), _mm_mul_ps(f, p));
+        auto scale = _mm_slli_epi32(_mm_add_epi32(whole, _mm_set1_epi32(127)), 23);
+        return _mm_mul_ps(p, _mm_castsi128_ps(scale));
+    }
+
+    void accumulate_sse2(const frame& f, size_t center, int step, group<group_size>& g) const {
+        const auto& in = f.current;
+        const auto abs_mask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+        const auto one = _mm_set1_ps(1.0f);
+        const auto normal_sharpness = _mm_set1_ps(float(normal_phi));
+        const auto depth_sharpness = _mm_set1_ps(float(depth_phi));
+        const auto penalty = _mm_set1_ps(boundary_penalty);
+
+        for (int lane = 0; lane < group_size; lane += 4) {
+            auto p = center + lane;
+            auto nx = _mm_loadu_ps(&f.normal_x[p]);
+            auto ny = _mm_loadu_ps(&f.normal_y[p]);
+            auto nz = _mm_loadu_ps(&f.normal_z[p]);
+            auto surface = _mm_loadu_ps(&f.surface[p]);
+            auto depth = _mm_loadu_ps(&f.depth[p]);
+            auto slope_x = _mm_loadu_ps(&f.slope_x[p]);
+            auto slope_y = _mm_loadu_ps(&f.slope_y[p]);
+            auto luminance = _mm_loadu_ps(&in.luminance[p]);
+            auto luminance_scale = _mm_load_ps(g.luminance_scale + lane);
+            auto depth_tolerance = _mm_load_ps(g.depth_tolerance + lane);
+            auto normal_scale = _mm_mul_ps(normal_sharpness, surface);
+
+            auto red = _mm_setzero_ps(), green = _mm_setzero_ps(), blue = _mm_setzero_ps();
+            auto noise = _mm_setzero_ps(), weight = _mm_setzero_ps();
+
+            for (int j = -2; j <= 2; j++) {
+                for (int i = -2; i <= 2; i++) {
+                    auto q = p + ptrdiff_t(j*step)*f.width + i*step;
+                    auto reach_x = _mm_set1_ps(float(step * std::abs(i)));
+                    auto reach_y = _mm_set1_ps(float(step * std::abs(j)));
+
+                    auto cos_normals = _mm_add_ps(_mm_add_ps(
+                        _mm_mul_ps(nx, _mm_loadu_ps(&f.normal_x[q])),
+                        _mm_mul_ps(ny, _mm_loadu_ps(&f.normal_y[q]))),
+                        _mm_mul_ps(nz, _mm_loadu_ps(&f.normal_z[q])));
+                    auto boundary = _mm_and_ps(abs_mask,
+                        _mm_sub_ps(surface, _mm_loadu_ps(&f.surface[q])));
+                    auto normal_term = _mm_add_ps(
+                        _mm_mul_ps(normal_scale, _mm_sub_ps(one, cos_normals)),
+                        _mm_mul_ps(penalty, boundary));
+
+                    auto expected = _mm_add_ps(_mm_mul_ps(reach_x, slope_x),
+                                               _mm_mul_ps(reach_y, slope_y));
+                    auto depth_term = _mm_div_ps(
+                        _mm_and_ps(abs_mask, _mm_sub_ps(_mm_loadu_ps(&f.depth[q]), depth)),
+                        _mm_add_ps(_mm_mul_ps(depth_sharpness, expected), depth_tolerance));
+
+                    auto luminance_term = _mm_mul_ps(luminance_scale, _mm_and_ps(abs_mask,
+                        _mm_sub_ps(_mm_loadu_ps(&in.luminance[q]), luminance)));
+
+                    auto exponent = _mm_add_ps(_mm_add_ps(normal_term, depth_term),
+                                               luminance_term);
+                    auto w = _mm_mul_ps(_mm_set1_ps(kernel[i + 2] * kernel[j + 2]),
+                                        exp_negative_sse2(_mm_sub_ps(_mm_setzero_ps(), exponent)));
+
+                    red = _mm_add_ps(red, _mm_mul_ps(w, _mm_loadu_ps(&in.red[q])));
+                    green = _mm_add_ps(green, _mm_mul_ps(w, _mm_loadu_ps(&in.green[q])));
+                    blue = _mm_add_ps(blue, _mm_mul_ps(w, _mm_loadu_ps(&in.blue[q])));
+                    noise = _mm_add_ps(noise,
+                        _mm_mul_ps(_mm_mul_ps(w, w), _mm_loadu_ps(&in.noise[q])));
+                    weight = _mm_add_ps(weight, w);
+                }
+            }
+
+            _mm_store_ps(g.red + lane, red);
+            _mm_store_ps(g.green + lane, green);
+            _mm_store_ps(g.blue + lane, blue);
+            _mm_store_ps(g.noise + lane, noise);
+            _mm_store_ps(g.weight + lane, weight);
+        }
+    }
+  #endif
+
+  #if RTW_SIMD_AVX2
+    RTW_TARGET_AVX2
+    static __m256 exp_negative_avx2(__m256 x) {
+        // exp_negative() on eight lanes.
+        x = _mm256_max_ps(_mm256_mul_ps(x, _mm256_set1_ps(1.44269504f)), _mm256_set1_ps(-60.0f));
+        auto whole = _mm256_cvttps_epi32(x);
+        auto f = _mm256_sub_ps(x, _mm256_cvtepi32_ps(whole));
+        auto p = _mm256_add_ps(_mm256_set1_ps(0.00961813f),
+                               _mm256_mul_ps(f, _mm256_set1_ps(0.00133336f)));
+        p = _mm256_add_ps(_mm256_set1_ps(0.05550411f), _mm256_mul_ps(f, p));
+        p = _mm256_add_ps(_mm256_set1_ps(0.24022651f), _mm256_mul_ps(f, p));
+        p = _mm256_add_ps(_mm256_set1_ps(0.69314718f), _mm256_mul_ps(f, p));
+        p = _mm256_add_ps(_mm256_set1_ps(1.0f), _mm256_mul_ps(f, p));
+        auto scale = _mm256_slli_epi32(_mm256_add_epi32(whole, _mm256_set1_epi32(127)), 23);
+        return _mm256_mul_ps(p, _mm256_castsi256_ps(scale));
+    }
+
+    RTW_TARGET_AVX2
+    void accumulate_avx2(const frame& f, size_t center, int step, group<group_size>& g) const {
+        const auto& in = f.current;
+        const auto abs_mask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+        const auto one = _mm256_set1_ps(1.0f);
+        const auto depth_sharpness = _mm256_set1_ps(float(depth_phi));
+        const auto penalty = _mm256_set1_ps(boundary_penalty);
+
+        auto p = center;
+        auto nx = _mm256_loadu_ps(&f.normal_x[p]);
+        auto ny = _mm256_loadu_ps(&f.normal_y[p]);
+        auto nz = _mm256_loadu_ps(&f.normal_z[p]);
+        auto surface = _mm256_loadu_ps(&f.surface[p]);
+        auto depth = _mm256_loadu_ps(&f.depth[p]);
+        auto slope_x = _mm256_loadu_ps(&f.slope_x[p]);
+        auto slope_y = _mm256_loadu_ps(&f.slope_y[p]);
+        auto luminance = _mm256_loadu_ps(&in.luminance[p]);
+        auto luminance_scale = _mm256_load_ps(g.luminance_scale);
+        auto depth_tolerance = _mm256_load_ps(g.depth_tolerance);
+        auto normal_scale = _mm256_mul_ps(_mm256_set1_ps(float(normal_phi)), surface);
+
+        auto red = _mm256_setzero_ps(), green = _mm256_setzero_ps(), blue = _mm256_setzero_ps();
+        auto noise = _mm256_setzero_ps(), weight = _mm256_setzero_ps();
+
+        for (int j = -2; j <= 2; j++) {
+            for (int i = -2; i <= 2; i++) {
+                auto q = p + ptrdiff_t(j*step)*f.width + i*step;
+                auto reach_x = _mm256_set1_ps(float(step * std::abs(i)));
+                auto reach_y = _mm256_set1_ps(float(step * std::abs(j)));
+
+                auto cos_normals = _mm256_add_ps(_mm256_add_ps(
+                    _mm256_mul_ps(nx, _mm256_loadu_ps(&f.normal_x[q])),
+                    _mm256_mul_ps(ny, _mm256_loadu_ps(&f.normal_y[q]))),
+                    _mm256_mul_ps(nz, _mm256_loadu_ps(&f.normal_z[q])));
+                auto boundary = _mm256_and_ps(abs_mask,
+                    _mm256_sub_ps(surface, _mm256_loadu_ps(&f.surface[q])));
+                auto normal_term = _mm256_add_ps(
+                    _mm256_mul_ps(normal_scale, _mm256_sub_ps(one, cos_normals)),
+                    _mm256_mul_ps(penalty, boundary));
+
+                auto expected = _mm256_add_ps(_mm256_mul_ps(reach_x, slope_x),
+                                              _mm256_mul_ps(reach_y, slope_y));
+                auto depth_term = _mm256_div_ps(
+                    _mm256_and_ps(abs_mask, _mm256_sub_ps(_mm256_loadu_ps(&f.depth[q]), depth)),
+                    _mm256_add_ps(_mm256_mul_ps(depth_sharpness, expected), depth_tolerance));
+
+                auto luminance_term = _mm256_mul_ps(luminance_scale, _mm256_and_ps(abs_mask,
+                    _mm256_sub_ps(_mm256_loadu_ps(&in.luminance[q]), luminance)));
+
+                auto exponent = _mm256_add_ps(_mm256_add_ps(normal_term, depth_term),
+                                              luminance_term);
+                auto w = _mm256_mul_ps(_mm256_set1_ps(kernel[i + 2] * kernel[j + 2]),
+                    exp_negative_avx2(_mm256_sub_ps(_mm256_setzero_ps(), exponent)));
+
+                red = _mm256_add_ps(red, _mm256_mul_ps(w, _mm256_loadu_ps(&in.red[q])));
+                green = _mm256_add_ps(green, _mm256_mul_ps(w, _mm256_loadu_ps(&in.green[q])));
+                blue = _mm256_add_ps(blue, _mm256_mul_ps(w, _mm256_loadu_ps(&in.blue[q])));
+                noise = _mm256_add_ps(noise,
+                    _mm256_mul_ps(_mm256_mul_ps(w, w), _mm256_loadu_ps(&in.noise[q])));
+                weight = _mm256_add_ps(weight, w);
+            }
+        }
+
+        _mm256_store_ps(g.red, red);
+        _mm256_store_ps(g.green, green);
+        _mm256_store_ps(g.blue, blue);
+        _mm256_store_ps(g.noise, noise);
+        _mm256_store_ps(g.weight, weight);
+    }
+  #endif
+};
+
+
+#endif
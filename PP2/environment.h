@@ -0,0 +1,177 @@
+#ifndef ENVIRONMENT_H
+#define ENVIRONMENT_H
+//==============================================================================================
+// To the extent possible under law, the author(s) have dedicated all copyright and related and
+// neighboring rights to this software to the public domain worldwide. This software is
+// distributed without any warranty.
+//
+// You should have received a copy (see file COPYING.txt) of the CC0 Public Domain Dedication
+// along with this software. If not, see <http://creativecommons.org/publicdomain/zero/1.0/>.
+//==============================================================================================
+
+#include "rtw_stb_image.h"
+
+#include <vector>
+
+
+class environment_map {
+  public:
+    // Light arriving from infinitely far away, read from an equirectangular (latitude-longitude)
+    // image: the top row looks straight up (+Y), and columns go around the Y axis the same way
+    // sphere texture coordinates do. HDR images (.hdr) keep their full range; other formats are
+    // converted to linear values in [0,1]. An image that fails to load shows as magenta.
+    //
+    // Directions can be sampled in proportion to the brightness of the image, so that the sky
+    // (and above all a sun in it) can be sampled directly as a light. Each pixel is picked from
+    // an alias table in constant time, and the direction is then spread uniformly over it.
+
+    environment_map(const char* filename, double intensity = 1.0)
+      : image(filename), intensity(intensity)
+    {
+        width = std::max(image.width(), 1);
+        height = std::max(image.height(), 1);
+        build_sampling_table();
+    }
+
+    color value(const vec3& direction) const {
+        // Returns the light arriving along the given direction, from the pixel it points at.
+        int x, y;
+        pixel_at(direction, x, y);
+        auto pixel = image.linear_pixel_data(x, y);
+        return intensity * color(pixel[0], pixel[1], pixel[2]);
+    }
+
+    vec3 random(double& pdf) const {
+        // Returns a unit direction toward a random point of the image, with probability
+        // proportional to its brightness, and sets pdf to its density per unit solid angle.
+        // The offset within the pixel is drawn first, so that a 2D sample lands on it.
+        double offset[2];
+        random_doubles(offset, 2);
+
+        auto pick = random_double() * double(alias.size());
+        auto index = std::min(size_t(pick), alias.size() - 1);
+        if (pick - double(index) >= alias[index].threshold)
+            index = alias[index].other;
+
+        auto x = int(index % width);
+        auto y = int(index / width);
+        auto phi = 2*pi * (x + offset[0]) / width;
+        auto theta = pi * (1 - (y + offset[1]) / height);
+
+        auto sin_theta = std::sin(theta);
+        pdf = density(index, sin_theta);
+        return vec3(-std::cos(phi)*sin_theta, -std::cos(theta), std::sin(phi)*sin_theta);
+    }
+
+    double pdf_value(const vec3& direction) const {
+        // The density per unit solid angle with which random() returns the given direction.
+        int x, y;
+        pixel_at(direction, x, y);
+        auto horizontal = std::sqrt(direction.x()*direction.x() + direction.z()*direction.z());
+        return density(size_t(y)*width + x, horizontal / direction.length());
+    }
+
+  private:
+    struct alias_entry {
+        double threshold;  // Keep this entry if the fractional part of the pick is below this
+        size_t other;      // Otherwise, take this one
+    };
+
+    rtw_image image;
+    double intensity;
+    int width, height;
+    std::vector<alias_entry> alias;
+    std::vector<double> probabilities;  // Probability of picking each pixel
+
+    void pixel_at(const vec3& d, int& x, int& y) const {
+        // The pixel that a direction points at, using the sphere's texture mapping with V
+        // flipped to image rows. Every ray that escapes the scene comes through here, so both
+        // angles come from fast_atan2(), which also makes normalizing the direction unneeded.
+        auto horizontal = std::sqrt(d.x()*d.x() + d.z()*d.z());
+        auto theta = fast_atan2(horizontal, -d.y());
+        auto phi = fast_atan2(-d.z(), d.x()) + pi;
+        x = std::max(std::min(int(phi / (2*pi) * width), width - 1), 0);
+        y = std::max(std::min(int((1 - theta / pi) * height), height - 1), 0);
+    }
+
+    static double fast_atan2(double y, double x) {
+        // atan2() to within 2e-6 radians, a small fraction of a pixel even for large images,
+        // from a polynomial fit of atan() over [0,1] and the symmetries of the octants. The
+        // octant fixups are arithmetic rather than branches, which random directions would
+        // keep mispredicting.
+        auto ax = std::fabs(x), ay = std::fabs(y);
+        auto a = std::min(ax, ay) / (std::max(ax, ay) + 1e-300);
+        auto s = a*a;
+        auto r = a*(0.99997726 + s*(-0.33262347 + s*(0.19354346 + s*(-0.11643287
+                    + s*(0.05265332 + s*(-0.01172120))))));
+        r += double(ay > ax) * (pi/2 - 2*r);
+        r += double(x < 0) * (pi - 2*r);
+        return std::copysign(r, y);
+    }
+
+    double density(size_t index, double sin_theta) const {
+        // Converts the probability of a pixel to a density per unit solid angle: the pixel
+        // covers 2*pi*pi*sin(theta) / (width*height) steradians around the given latitude.
+        if (sin_theta <= 0)
+            return 0;
+        return probabilities[index] * width * height / (2*pi*pi * sin_theta);
+    }
+
+    void build_sampling_table() {
+        // Each pixel is weighted by its luminance and by the solid angle it covers, which
+        // shrinks toward the poles. A black image falls back to sampling all directions evenly.
+        auto count = size_t(width) * height;
+        probabilities.resize(count);
+
+        double total = 0;
+        for (int y = 0; y < height; y++) {
+            auto sin_theta = std::sin(pi * (1 - (y + 0.5) / height));
+            for (int x = 0; x < width; x++) {
+                auto pixel = image.linear_pixel_data(x, y);
+                auto luminance = 0.2126*pixel[0] + 0.7152*pixel[1] + 0.0722*pixel[2];
+                auto& weight = probabilities[size_t(y)*width + x];
+                weight = std::fmax(luminance, 0.0) * sin_theta;
+                total += weight;
+            }
+        }
+
+        if (total <= 0) {
+            total = 0;
+            for (size_t i = 0; i < count; i++) {
+                probabilities[i] = std::sin(pi * (1 - (i / width + 0.5) / height));
+                total += probabilities[i];
+            }
+        }
+
+        for (auto& p : probabilities)
+            p /= total;
+
+        // Vose's alias method: scale the probabilities so they average 1, then repeatedly top
+        // up an entry below 1 with the excess of an entry above 1, which becomes its alias.
+        alias.resize(count);
+        std::vector<double> scaled(count);
+        std::vector<size_t> small, large;
+        for (size_t i = 0; i < count; i++) {
+            scaled[i] = probabilities[i] * count;
+            (scaled[i] < 1 ? small : large).push_back(i);
+        }
+
+        while (!small.empty() && !large.empty()) {
+            auto s = small.back(); small.pop_back();
+            auto l = large.back();
+            alias[s] = alias_entry{scaled[s], l};
+            scaled[l] -= 1 - scaled[s];
+            if (scaled[l] < 1) {
+                large.pop_back();
+                small.push_back(l);
+            }
+        }
+
+        // What is left is 1 up to rounding error.
+        for (auto i : small) alias[i] = alias_entry{1, i};
+        for (auto i : large) alias[i] = alias_entry{1, i};
+    }
+};
+
+
+#endif
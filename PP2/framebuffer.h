@@ -0,0 +1,179 @@
+#ifndef FRAMEBUFFER_H
+#define FRAMEBUFFER_H
+//==============================================================================================
+// To the extent possible under law, the author(s) have dedicated all copyright and related and
+// neighboring rights to this software to the public domain worldwide. This software is
+// distributed without any warranty.
+//
+// You should have received a copy (see file COPYING.txt) of the CC0 Public Domain Dedication
+// along with this software. If not, see <http://creativecommons.org/publicdomain/zero/1.0/>.
+//==============================================================================================
+
+#include "rtweekend.h"
+
+// Disable strict warnings for this header from the Microsoft Visual C++ compiler.
+#ifdef _MSC_VER
+    #pragma warning (push, 0)
+#endif
+
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include "stb_image_write.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+
+class framebuffer {
+  public:
+    framebuffer() {}
+
+    framebuffer(int width, int height)
+      : image_width(width), image_height(height), data(size_t(width) * height * 3, 0.0f) {}
+
+    int width()  const { return image_width; }
+    int height() const { return image_height; }
+
+    // Linear RGB floats, three per pixel, left to right and then top to bottom.
+    const float* pixels() const { return data.data(); }
+    float*       pixels()       { return data.data(); }
+
+    color get(int x, int y) const {
+        auto p = &data[3 * (size_t(y)*image_width + x)];
+        return color(p[0], p[1], p[2]);
+    }
+
+    void set(int x, int y, const color& c) {
+        auto p = &data[3 * (size_t(y)*image_width + x)];
+        p[0] = float(c.x());
+        p[1] = float(c.y());
+        p[2] = float(c.z());
+    }
+
+    std::vector<unsigned char> to_bytes() const {
+        // Applies the gamma 2 transform and quantizes to [0,255] over the whole buffer at once,
+        // as one flat loop over the components. Each stored component goes through the same
+        // double precision steps as in write_color(), but it was rounded to float when stored,
+        // so a color lying within float rounding of a byte boundary can come out one step
+        // off from writing the unrounded color.
+
+        std::vector<unsigned char> bytes(data.size());
+        const float* in = data.data();
+        unsigned char* out = bytes.data();
+
+        for (size_t i = 0, n = data.size(); i < n; i++) {
+            double c = std::sqrt(std::max(0.0, double(in[i])));  // Also maps NaN to black
+            c = std::min(c, 0.999);
+            out[i] = static_cast<unsigned char>(256 * c);
+        }
+
+        return bytes;
+    }
+
+    bool write(const std::string& filename) const {
+        // Writes the image to the given file, picking the format from the file extension:
+        // .png, .ppm (binary P6), .pfm (32-bit float) or .hdr (Radiance RGBE).
+
+        auto dot = filename.find_last_of('.');
+        auto extension = (dot == std::string::npos) ? std::string() : filename.substr(dot + 1);
+        std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+
+        bool ok;
+        if      (extension == "png") ok = write_png(filename);
+        else if (extension == "ppm") ok = write_ppm(filename);
+        else if (extension == "pfm") ok = write_pfm(filename);
+        else if (extension == "hdr") ok = write_hdr(filename);
+        else {
+            std::cerr << "ERROR: Unsupported image format for '" << filename << "'.\n";
+            return false;
+        }
+
+        if (!ok)
+            std::cerr << "ERROR: Could not write image file '" << filename << "'.\n";
+        return ok;
+    }
+
+    bool write_png(const std::string& filename) const {
+        auto bytes = to_bytes();
+        return stbi_write_png(
+            filename.c_str(), image_width, image_height, 3, bytes.data(), 3 * image_width
+        ) != 0;
+    }
+
+    bool write_ppm(const std::string& filename) const {
+        auto bytes = to_bytes();
+
+        auto file = std::fopen(filename.c_str(), "wb");
+        if (!file) return false;
+
+        std::fprintf(file, "P6\n%d %d\n255\n", image_width, image_height);
+        bool ok = std::fwrite(bytes.data(), 1, bytes.size(), file) == bytes.size();
+        return (std::fclose(file) == 0) && ok;
+    }
+
+    bool write_pfm(const std::string& filename) const {
+        // PFM stores linear floats with the scanlines ordered bottom to top. A negative scale
+        // marks little-endian data.
+
+        auto file = std::fopen(filename.c_str(), "wb");
+        if (!file) return false;
+
+        std::fprintf(file, "PF\n%d %d\n%s\n", image_width, image_height,
+                     is_little_endian() ? "-1.0" : "1.0");
+
+        bool ok = true;
+        size_t row_floats = 3 * size_t(image_width);
+        for (int j = image_height - 1; j >= 0 && ok; j--)
+            ok = std::fwrite(&data[j * row_floats], sizeof(float), row_floats, file) == row_floats;
+
+        return (std::fclose(file) == 0) && ok;
+    }
+
+    bool write_hdr(const std::string& filename) const {
+        return stbi_write_hdr(filename.c_str(), image_width, image_height, 3, data.data()) != 0;
+    }
+
+    void write_p3(std::ostream& out) const {
+        // Writes the image as a plain-text PPM, as the renderer has always done on stdout.
+
+        auto bytes = to_bytes();
+        std::string text;
+        text.reserve(bytes.size() * 4);
+
+        char number[4];
+        for (size_t i = 0; i < bytes.size(); i++) {
+            auto length = std::snprintf(number, sizeof(number), "%d", bytes[i]);
+            text.append(number, length);
+            text.push_back((i % 3 == 2) ? '\n' : ' ');
+        }
+
+        out << "P3\n" << image_width << ' ' << image_height << "\n255\n" << text;
+    }
+
+  private:
+    int image_width = 0;
+    int image_height = 0;
+    std::vector<float> data;
+
+    static bool is_little_endian() {
+        uint16_t probe = 1;
+        unsigned char first;
+        std::memcpy(&first, &probe, 1);
+        return first == 1;
+    }
+};
+
+
+// Restore MSVC compiler warnings
+#ifdef _MSC_VER
+    #pragma warning (pop)
+#endif
+
+
+#endif
@@ -12,8 +12,10 @@
 //==============================================================================================
 
 #include "aabb.h"
+#include "mat4.h"
 
 
+class hittable;
 class material;
 
 
@@ -22,6 +24,7 @@ class hit_record {
     point3 p;
     vec3 normal;
     shared_ptr<material> mat;
+    const hittable* object;  // The primitive that was hit
     double t;
     double u;
     double v;
@@ -43,122 +46,200 @@ class hittable {
 
     virtual bool hit(const ray& r, interval ray_t, hit_record& rec) const = 0;
 
+    // Returns true if the ray hits the object anywhere in ray_t. Shadow and visibility rays
+    // only need this answer, so overrides stop at the first hit they find and never fill in
+    // hit record attributes. The default falls back on the closest-hit query.
+    virtual bool occluded(const ray& r, interval ray_t) const {
+        hit_record rec;
+        return hit(r, ray_t, rec);
+    }
+
     virtual aabb bounding_box() const = 0;
+
+    // Bounds of the object at the given shutter time in [0,1]. Moving objects override this
+    // with a box that varies linearly over the shutter interval; the default is the box over
+    // the whole interval.
+    virtual aabb bounding_box_at(double time) const { return bounding_box(); }
+
+    // Light sampling. Shapes that can act as area lights return their material from
+    // light_material(), so that the emissive ones can be collected into a light list, and
+    // implement the two functions below. random() returns a direction from origin toward a
+    // random point of the shape, and pdf_value() the density, per unit solid angle, with which
+    // random() picks the given direction. Both take the shape where it is at the given shutter
+    // time.
+    virtual shared_ptr<material> light_material() const { return nullptr; }
+
+    virtual double pdf_value(const point3& origin, const vec3& direction, double time) const {
+        return 0.0;
+    }
+
+    virtual vec3 random(const point3& origin, double time) const {
+        return vec3(1,0,0);
+    }
+
+    // Shape of an emitter, for light hierarchies that estimate how much light it sends toward
+    // a point: its surface area, and the cosine of the half angle of a cone around axis that
+    // holds all of its surface normals. The defaults, the area of the bounding box and normals
+    // facing every way, are safe for any shape.
+    virtual double surface_area() const { return bounding_box().surface_area(); }
+
+    virtual double normal_cone(vec3& axis) const {
+        axis = vec3(0,0,1);
+        return -1.0;
+    }
 };
 
 
-class translate : public hittable {
+class transform : public hittable {
   public:
-    translate(shared_ptr<hittable> object, const vec3& offset)
-      : object(object), offset(offset)
+    // Places an object in the world through an affine object-to-world matrix. Wrapping a
+    // transform in another transform folds the two matrices into one, so a chain of them costs
+    // a single ray transform per hit. A transformed light can be sampled like the object it
+    // wraps, and hits on the object itself report the transform as the object hit, so light
+    // samplers recognize them.
+
+    transform(shared_ptr<hittable> object, const mat4& object_to_world)
+      : object(object), object_to_world(object_to_world)
     {
-        bbox = object->bounding_box() + offset;
+        if (auto inner = std::dynamic_pointer_cast<transform>(object)) {
+            this->object = inner->object;
+            this->object_to_world = object_to_world * inner->object_to_world;
+        }
+
+        world_to_object = this->object_to_world.inverse();
+        volume_scale = std::fabs(this->object_to_world.determinant());
+
+        bbox = transform_box(this->object->bounding_box());
     }
 
     bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
-        // Move the ray backwards by the offset
-        ray offset_r(r.origin() - offset, r.direction(), r.time());
+        // Transform the ray into object space. The direction is not renormalized, so hit
+        // distances mean the same thing in both spaces.
+        ray object_r(
+            world_to_object.transform_point(r.origin()),
+            world_to_object.transform_vector(r.direction()),
+            r.time()
+        );
 
-        // Determine whether an intersection exists along the offset ray (and if so, where)
-        if (!object->hit(offset_r, ray_t, rec))
+        if (!object->hit(object_r, ray_t, rec))
             return false;
 
-        // Move the intersection point forwards by the offset
-        rec.p += offset;
+        // Transform the intersection back to world space. Normals go through the inverse
+        // transpose, which keeps them perpendicular to the surface under non-uniform scaling.
+        rec.p = object_to_world.transform_point(rec.p);
+        rec.normal = unit_vector(world_to_object.transform_transposed(rec.normal));
+        if (rec.object == object.get())
+            rec.object = this;
 
         return true;
     }
 
+    bool occluded(const ray& r, interval ray_t) const override {
+        ray object_r(
+            world_to_object.transform_point(r.origin()),
+            world_to_object.transform_vector(r.direction()),
+            r.time()
+        );
+        return object->occluded(object_r, ray_t);
+    }
+
     aabb bounding_box() const override { return bbox; }
 
+    aabb bounding_box_at(double time) const override {
+        return transform_box(object->bounding_box_at(time));
+    }
+
+    shared_ptr<material> light_material() const override { return object->light_material(); }
+
+    double pdf_value(const point3& origin, const vec3& direction, double time) const override {
+        // The object samples directions in object space. The 3x3 part L maps them to world
+        // space, and a unit world direction w covers |det L^-1| / |L^-1 w|^3 times the solid
+        // angle of its object space image, which divides the density.
+        auto object_direction = world_to_object.transform_vector(unit_vector(direction));
+        auto length = object_direction.length();
+        if (length == 0)
+            return 0;
+
+        auto object_origin = world_to_object.transform_point(origin);
+        return object->pdf_value(object_origin, object_direction, time)
+             / (volume_scale * length*length*length);
+    }
+
+    vec3 random(const point3& origin, double time) const override {
+        auto object_origin = world_to_object.transform_point(origin);
+        return object_to_world.transform_vector(object->random(object_origin, time));
+    }
+
+    double surface_area() const override {
+        // Exact for flat objects (by Nanson's formula, from the normal's transform) and for
+        // uniform scales; otherwise the area is scaled as a uniform scale of the same volume
+        // change would scale it.
+        vec3 axis;
+        auto area = object->surface_area();
+        if (object->normal_cone(axis) >= 1)
+            return area * volume_scale * world_to_object.transform_transposed(axis).length();
+        return area * std::pow(volume_scale, 2.0/3.0);
+    }
+
+    double normal_cone(vec3& axis) const override {
+        // A single normal maps to a single normal. Wider cones are not kept, since non-uniform
+        // scales change the angles between normals; all directions are returned instead.
+        vec3 object_axis;
+        if (object->normal_cone(object_axis) < 1) {
+            axis = vec3(0,0,1);
+            return -1.0;
+        }
+        axis = unit_vector(world_to_object.transform_transposed(object_axis));
+        return 1.0;
+    }
+
+    const mat4& matrix() const { return object_to_world; }
+
   private:
     shared_ptr<hittable> object;
-    vec3 offset;
+    mat4 object_to_world;
+    mat4 world_to_object;
+    double volume_scale;  // |det| of the object-to-world 3x3 part
     aabb bbox;
-};
-
-
-class rotate_y : public hittable {
-  public:
-    rotate_y(shared_ptr<hittable> object, double angle) : object(object) {
-        auto radians = degrees_to_radians(angle);
-        sin_theta = std::sin(radians);
-        cos_theta = std::cos(radians);
-        bbox = object->bounding_box();
 
+    aabb transform_box(const aabb& object_bbox) const {
+        // Bound the transformed corners of an object space box.
         point3 min( infinity,  infinity,  infinity);
         point3 max(-infinity, -infinity, -infinity);
 
         for (int i = 0; i < 2; i++) {
             for (int j = 0; j < 2; j++) {
                 for (int k = 0; k < 2; k++) {
-                    auto x = i*bbox.x.max + (1-i)*bbox.x.min;
-                    auto y = j*bbox.y.max + (1-j)*bbox.y.min;
-                    auto z = k*bbox.z.max + (1-k)*bbox.z.min;
-
-                    auto newx =  cos_theta*x + sin_theta*z;
-                    auto newz = -sin_theta*x + cos_theta*z;
-
-                    vec3 tester(newx, y, newz);
+                    auto corner = object_to_world.transform_point(point3(
+                        i ? object_bbox.x.max : object_bbox.x.min,
+                        j ? object_bbox.y.max : object_bbox.y.min,
+                        k ? object_bbox.z.max : object_bbox.z.min
+                    ));
 
                     for (int c = 0; c < 3; c++) {
-                        min[c] = std::fmin(min[c], tester[c]);
-                        max[c] = std::fmax(max[c], tester[c]);
+                        min[c] = std::fmin(min[c], corner[c]);
+                        max[c] = std::fmax(max[c], corner[c]);
                     }
                 }
             }
         }
 
-        bbox = aabb(min, max);
+        return aabb(min, max);
     }
+};
 
-    bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
-
-        // Transform the ray from world space to object space.
-
-        auto origin = point3(
-            (cos_theta * r.origin().x()) - (sin_theta * r.origin().z()),
-            r.origin().y(),
-            (sin_theta * r.origin().x()) + (cos_theta * r.origin().z())
-        );
-
-        auto direction = vec3(
-            (cos_theta * r.direction().x()) - (sin_theta * r.direction().z()),
-            r.direction().y(),
-            (sin_theta * r.direction().x()) + (cos_theta * r.direction().z())
-        );
-
-        ray rotated_r(origin, direction, r.time());
-
-        // Determine whether an intersection exists in object space (and if so, where).
-
-        if (!object->hit(rotated_r, ray_t, rec))
-            return false;
-
-        // Transform the intersection from object space back to world space.
-
-        rec.p = point3(
-            (cos_theta * rec.p.x()) + (sin_theta * rec.p.z()),
-            rec.p.y(),
-            (-sin_theta * rec.p.x()) + (cos_theta * rec.p.z())
-        );
-
-        rec.normal = vec3(
-            (cos_theta * rec.normal.x()) + (sin_theta * rec.normal.z()),
-            rec.normal.y(),
-            (-sin_theta * rec.normal.x()) + (cos_theta * rec.normal.z())
-        );
 
-        return true;
-    }
+class translate : public transform {
+  public:
+    translate(shared_ptr<hittable> object, const vec3& offset)
+      : transform(object, mat4::translation(offset)) {}
+};
 
-    aabb bounding_box() const override { return bbox; }
 
-  private:
-    shared_ptr<hittable> object;
-    double sin_theta;
-    double cos_theta;
-    aabb bbox;
+class rotate_y : public transform {
+  public:
+    rotate_y(shared_ptr<hittable> object, double angle)
+      : transform(object, mat4::rotation_y(angle)) {}
 };
 
 
@@ -47,8 +47,23 @@ class hittable_list : public hittable {
         return hit_anything;
     }
 
+    bool occluded(const ray& r, interval ray_t) const override {
+        for (const auto& object : objects) {
+            if (object->occluded(r, ray_t))
+                return true;
+        }
+        return false;
+    }
+
     aabb bounding_box() const override { return bbox; }
 
+    aabb bounding_box_at(double time) const override {
+        aabb box = aabb::empty;
+        for (const auto& object : objects)
+            box = aabb(box, object->bounding_box_at(time));
+        return box;
+    }
+
   private:
     aabb bbox;
 };
@@ -0,0 +1,210 @@
+#ifndef INSTANCE_BVH_H
+#define INSTANCE_BVH_H
+//==============================================================================================
+// To the extent possible under law, the author(s) have dedicated all copyright and related and
+// neighboring rights to this software to the public domain worldwide. This software is
+// distributed without any warranty.
+//
+// You should have received a copy (see file COPYING.txt) of the CC0 Public Domain Dedication
+// along with this software. If not, see <http://creativecommons.org/publicdomain/zero/1.0/>.
+//==============================================================================================
+
+#include "hittable.h"
+#include "linear_bvh.h"
+
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+
+class instance_record {
+  public:
+    // One placement of a prototype. Only the world-to-object rows are kept: the hit point is
+    // recomputed from the world space ray, and the normal needs just the transpose of this
+    // matrix, so the object-to-world matrix is never needed after the bounds are known.
+
+    double   world_to_object[3][4];
+    uint32_t prototype;
+
+    point3 to_object_point(const point3& p) const {
+        const auto& m = world_to_object;
+        return point3(
+            m[0][0]*p.x() + m[0][1]*p.y() + m[0][2]*p.z() + m[0][3],
+            m[1][0]*p.x() + m[1][1]*p.y() + m[1][2]*p.z() + m[1][3],
+            m[2][0]*p.x() + m[2][1]*p.y() + m[2][2]*p.z() + m[2][3]
+        );
+    }
+
+    vec3 to_object_vector(const vec3& v) const {
+        const auto& m = world_to_object;
+        return vec3(
+            m[0][0]*v.x() + m[0][1]*v.y() + m[0][2]*v.z(),
+            m[1][0]*v.x() + m[1][1]*v.y() + m[1][2]*v.z(),
+            m[2][0]*v.x() + m[2][1]*v.y() + m[2][2]*v.z()
+        );
+    }
+
+    vec3 to_world_normal(const vec3& n) const {
+        const auto& m = world_to_object;
+        return unit_vector(vec3(
+            m[0][0]*n.x() + m[1][0]*n.y() + m[2][0]*n.z(),
+            m[0][1]*n.x() + m[1][1]*n.y() + m[2][1]*n.z(),
+            m[0][2]*n.x() + m[1][2]*n.y() + m[2][2]*n.z()
+        ));
+    }
+};
+
+
+class instance_bvh : public hittable {
+  public:
+    // A two-level acceleration structure. Each prototype is a piece of geometry (usually with
+    // its own BVH, the bottom level) that is stored once. Instances place a prototype in the
+    // world with a transform, and the top-level BVH is built over the instance bounds. Memory
+    // grows with the unique geometry plus one small record per instance.
+    //
+    // Add the prototypes and instances first, then call build() once before rendering. The
+    // builder's instance boxes are freed once the tree is built, so instances added after
+    // build() are refused with an error, and so is a second build().
+
+    int add_prototype(shared_ptr<hittable> geometry) {
+        // Returns the index used to refer to the prototype in add_instance().
+        prototypes.push_back(geometry);
+        prototype_boxes.push_back(geometry->bounding_box());
+        return int(prototypes.size()) - 1;
+    }
+
+    void add_instance(int prototype, const mat4& object_to_world) {
+        if (built) {
+            std::cerr << "ERROR: Instance added after the instance BVH was built.\n";
+            return;
+        }
+        if (prototype < 0 || prototype >= int(prototypes.size()))
+            return;
+
+        instance_record instance;
+        auto inverse = object_to_world.inverse();
+        for (int i = 0; i < 3; i++)
+            for (int j = 0; j < 4; j++)
+                instance.world_to_object[i][j] = inverse.m[i][j];
+        instance.prototype = uint32_t(prototype);
+        instances.push_back(instance);
+
+        // Bound the transformed corners of the prototype's box.
+        const auto& box = prototype_boxes[prototype];
+        auto bounds = aabb::empty;
+        for (int c = 0; c < 8; c++) {
+            auto corner = object_to_world.transform_point(point3(
+                (c & 1) ? box.x.max : box.x.min,
+                (c & 2) ? box.y.max : box.y.min,
+                (c & 4) ? box.z.max : box.z.min
+            ));
+            bounds = aabb(bounds, aabb(corner, corner));
+        }
+        instance_boxes.push_back(bounds);
+    }
+
+    void build(const bvh_build_options& options = linear_bvh::sah_options(),
+               int max_leaf_size = 2)
+    {
+        if (built) {
+            std::cerr << "ERROR: The instance BVH was already built.\n";
+            return;
+        }
+        built = true;
+
+        auto start_time = std::chrono::steady_clock::now();
+
+        std::vector<int> order;
+        auto cost = build_linear_bvh(instance_boxes, options, max_leaf_size, nodes, order);
+
+        // Store the instances in leaf order, so that a leaf references a contiguous range.
+        std::vector<instance_record> ordered;
+        ordered.reserve(order.size());
+        for (auto index : order)
+            ordered.push_back(instances[index]);
+        instances.swap(ordered);
+
+        // The instance boxes are only needed by the builder; the tree nodes now hold them.
+        instance_boxes.clear();
+        instance_boxes.shrink_to_fit();
+
+        std::chrono::duration<double, std::milli> elapsed =
+            std::chrono::steady_clock::now() - start_time;
+
+        std::clog << "Instance BVH: " << prototypes.size() << " prototypes, "
+                  << instances.size() << " instances, " << nodes.size() << " nodes, "
+                  << memory_per_instance() << " bytes per instance, SAH cost " << cost
+                  << ", built in " << elapsed.count() << " ms\n";
+    }
+
+    bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
+        return traverse_linear_bvh(nodes, r, ray_t,
+            [&](int first, int count, interval& t) {
+                hit_record temp_rec;
+                bool hit_anything = false;
+                for (int i = first; i < first + count; i++) {
+                    const auto& instance = instances[i];
+
+                    // The direction is not renormalized, so hit distances are shared with the
+                    // world space ray.
+                    ray object_r(
+                        instance.to_object_point(r.origin()),
+                        instance.to_object_vector(r.direction()),
+                        r.time()
+                    );
+
+                    if (prototypes[instance.prototype]->hit(object_r, t, temp_rec)) {
+                        hit_anything = true;
+                        t.max = temp_rec.t;
+                        rec = temp_rec;
+                        rec.p = r.at(rec.t);
+                        rec.normal = instance.to_world_normal(rec.normal);
+                    }
+                }
+                return hit_anything;
+            });
+    }
+
+    bool occluded(const ray& r, interval ray_t) const override {
+        return occluded_linear_bvh(nodes, r, ray_t,
+            [&](int first, int count, const interval& t) {
+                for (int i = first; i < first + count; i++) {
+                    const auto& instance = instances[i];
+                    ray object_r(
+                        instance.to_object_point(r.origin()),
+                        instance.to_object_vector(r.direction()),
+                        r.time()
+                    );
+                    if (prototypes[instance.prototype]->occluded(object_r, t))
+                        return true;
+                }
+                return false;
+            });
+    }
+
+    aabb bounding_box() const override {
+        return nodes.empty() ? aabb::empty : nodes[0].bbox;
+    }
+
+    size_t instance_count() const { return instances.size(); }
+
+    double memory_per_instance() const {
+        // Bytes of top-level storage (instance records and tree nodes) per instance. The
+        // prototypes are not included.
+        if (instances.empty()) return 0;
+        auto bytes = instances.size() * sizeof(instance_record)
+                   + nodes.size() * sizeof(linear_bvh_node);
+        return double(bytes) / instances.size();
+    }
+
+  private:
+    std::vector<shared_ptr<hittable>> prototypes;
+    std::vector<aabb> prototype_boxes;
+    std::vector<instance_record> instances;
+    std::vector<aabb> instance_boxes;   // Emptied by build()
+    std::vector<linear_bvh_node> nodes;
+    bool built = false;
+};
+
+
+#endif
@@ -0,0 +1,293 @@
+#ifndef LIGHT_BVH_H
+#define LIGHT_BVH_H
+//==============================================================================================
+// To the extent possible under law, the author(s) have dedicated all copyright and related and
+// neighboring rights to this software to the public domain worldwide. This software is
+// distributed without any warranty.
+//
+// You should have received a copy (see file COPYING.txt) of the CC0 Public Domain Dedication
+// along with this software. If not, see <http://creativecommons.org/publicdomain/zero/1.0/>.
+//==============================================================================================
+
+#include "light_list.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+
+class light_bounds {
+  public:
+    // What a light hierarchy node knows about the emitters below it: where they are, how much
+    // power they emit in total, and a cone (axis and cosine of its half angle) holding all of
+    // their surface normals. Emission is two-sided, so a normal and its opposite are the same.
+    aabb box;
+    vec3 axis = vec3(0,0,1);
+    double cos_theta = -1;
+    double power = 0;
+
+    light_bounds() {}
+
+    light_bounds(const hittable& light) {
+        box = light.bounding_box();
+        cos_theta = light.normal_cone(axis);
+
+        // Power is estimated from the emission at the middle of the light's texture.
+        auto emit = light.light_material()->emitted(0.5, 0.5, center());
+        auto luminance = 0.2126*emit.x() + 0.7152*emit.y() + 0.0722*emit.z();
+        power = pi * std::fmax(luminance, 0.0) * light.surface_area();
+    }
+
+    light_bounds(const light_bounds& a, const light_bounds& b) {
+        box = aabb(a.box, b.box);
+        power = a.power + b.power;
+
+        // The union of the two normal cones. b's axis is flipped if that brings it closer to
+        // a's, since emission is two-sided.
+        auto b_axis = dot(a.axis, b.axis) < 0 ? -b.axis : b.axis;
+        auto theta_a = std::acos(interval(-1,1).clamp(a.cos_theta));
+        auto theta_b = std::acos(interval(-1,1).clamp(b.cos_theta));
+        auto theta_d = std::acos(interval(-1,1).clamp(dot(a.axis, b_axis)));
+
+        if (std::fmin(theta_d + theta_b, pi) <= theta_a) {
+            axis = a.axis;
+            cos_theta = a.cos_theta;
+            return;
+        }
+        if (std::fmin(theta_d + theta_a, pi) <= theta_b) {
+            axis = b_axis;
+            cos_theta = b.cos_theta;
+            return;
+        }
+
+        // Otherwise the new cone's axis lies between the two, a's axis turned toward b's.
+        auto theta_o = (theta_a + theta_d + theta_b) / 2;
+        auto turn_axis = cross(a.axis, b_axis);
+        if (theta_o >= pi || turn_axis.near_zero()) {
+            axis = a.axis;
+            cos_theta = -1;
+            return;
+        }
+
+        auto turn = theta_o - theta_a;
+        axis = unit_vector(std::cos(turn)*a.axis
+                           + std::sin(turn)*cross(unit_vector(turn_axis), a.axis));
+        cos_theta = std::cos(theta_o);
+    }
+
+    point3 center() const {
+        return 0.5 * point3(box.x.min + box.x.max, box.y.min + box.y.max, box.z.min + box.z.max);
+    }
+
+    double importance(const point3& p, const vec3& n) const {
+        // A conservative estimate of the light these emitters send to the shading point: their
+        // power, over the squared distance, times the best cosines that any emitter in the box
+        // could have toward p, and that p could have toward any point of the box.
+        if (power <= 0)
+            return 0;
+
+        auto half_diagonal = 0.5 * vec3(box.x.size(), box.y.size(), box.z.size());
+        auto radius_squared = half_diagonal.length_squared();
+        auto to_p = p - center();
+        auto distance_squared = to_p.length_squared();
+
+        // The angle the box's bounding sphere subtends from p. From inside the sphere, the
+        // emitters may lie in any direction.
+        double sin_b = 0, cos_b = -1;
+        if (distance_squared > radius_squared) {
+            sin_b = std::sqrt(radius_squared / distance_squared);
+            cos_b = std::sqrt(1 - radius_squared / distance_squared);
+        }
+
+        // The smallest angle between an emitter normal and the direction to p, allowing for
+        // the spread of the normals and for the size of the box.
+        auto w = (distance_squared > 0) ? to_p / std::sqrt(distance_squared) : vec3(0,0,1);
+        auto cos_w = std::fabs(dot(axis, w));
+        auto sin_w = std::sqrt(std::fmax(0.0, 1 - cos_w*cos_w));
+        auto sin_o = std::sqrt(std::fmax(0.0, 1 - cos_theta*cos_theta));
+        auto cos_x = cos_minus_clamped(sin_w, cos_w, sin_o, cos_theta);
+        auto sin_x = sin_minus_clamped(sin_w, cos_w, sin_o, cos_theta);
+        auto cos_e = cos_minus_clamped(sin_x, cos_x, sin_b, cos_b);
+        if (cos_e <= 0)
+            return 0;
+
+        auto result = power * cos_e / std::fmax(distance_squared, radius_squared);
+
+        // The same, for the angle between the shading normal and the direction to the box.
+        if (!n.near_zero()) {
+            auto cos_i = std::fabs(dot(w, n)) / n.length();
+            auto sin_i = std::sqrt(std::fmax(0.0, 1 - cos_i*cos_i));
+            result *= cos_minus_clamped(sin_i, cos_i, sin_b, cos_b);
+        }
+
+        return std::fmax(result, 0.0);
+    }
+
+  private:
+    // cos(max(0, a - b)) and sin(max(0, a - b)) for angles a and b in [0, pi].
+    static double cos_minus_clamped(double sin_a, double cos_a, double sin_b, double cos_b) {
+        return (cos_a > cos_b) ? 1 : cos_a*cos_b + sin_a*sin_b;
+    }
+
+    static double sin_minus_clamped(double sin_a, double cos_a, double sin_b, double cos_b) {
+        return (cos_a > cos_b) ? 0 : sin_a*cos_b - cos_a*sin_b;
+    }
+};
+
+
+class light_bvh : public light_sampler {
+  public:
+    // A bounding volume hierarchy over the emitters of a scene, for scenes with many lights.
+    // Each node holds the light_bounds of the emitters below it. A light is picked by walking
+    // down from the root, choosing each child with probability proportional to its estimated
+    // importance to the shading point, so a pick costs time logarithmic in the light count and
+    // nearby, bright, well-oriented lights are sampled most often.
+
+    light_bvh(const hittable_list& world) : light_bvh(light_list(world)) {}
+
+    light_bvh(const light_list& list) : lights(list.objects()) {
+        if (lights.empty())
+            return;
+
+        std::vector<build_item> items;
+        for (size_t i = 0; i < lights.size(); i++) {
+            light_bounds bounds(*lights[i]);
+            items.push_back(build_item{bounds, bounds.center(), int(i)});
+        }
+
+        nodes.reserve(2 * lights.size() - 1);
+        build(items, 0, items.size(), 0, 0);
+        std::sort(trails.begin(), trails.end());
+    }
+
+    bool empty() const override { return lights.empty(); }
+    size_t size() const { return lights.size(); }
+
+    bool contains(const hittable* object) const override {
+        return find_trail(object) != trails.end();
+    }
+
+    const hittable* sample(const point3& p, const vec3& n, double& probability) const override {
+        if (nodes.empty())
+            return nullptr;
+
+        // A single random number steers the whole descent: after each choice it is rescaled
+        // to [0,1) within the part of the interval that choice took.
+        auto u = random_double();
+        probability = 1;
+        int index = 0;
+        while (!nodes[index].leaf) {
+            auto first = nodes[index + 1].bounds.importance(p, n);
+            auto second = nodes[nodes[index].offset].bounds.importance(p, n);
+            if (first + second <= 0)
+                return nullptr;
+
+            auto first_probability = first / (first + second);
+            if (u < first_probability) {
+                u = std::fmin(u / first_probability, 1 - 0x1.0p-53);
+                probability *= first_probability;
+                index = index + 1;
+            } else {
+                u = std::fmin((u - first_probability) / (1 - first_probability), 1 - 0x1.0p-53);
+                probability *= 1 - first_probability;
+                index = nodes[index].offset;
+            }
+        }
+
+        return lights[nodes[index].offset].get();
+    }
+
+    double probability(const point3& p, const vec3& n, const hittable* light) const override {
+        // Retraces the choices sample() would have made to reach the light, following the path
+        // to its leaf recorded at build time.
+        auto trail = find_trail(light);
+        if (trail == trails.end())
+            return 0;
+
+        double probability = 1;
+        int index = 0;
+        for (auto bits = trail->second; !nodes[index].leaf; bits >>= 1) {
+            auto first = nodes[index + 1].bounds.importance(p, n);
+            auto second = nodes[nodes[index].offset].bounds.importance(p, n);
+            if (first + second <= 0)
+                return 0;
+
+            if (bits & 1) {
+                probability *= second / (first + second);
+                index = nodes[index].offset;
+            } else {
+                probability *= first / (first + second);
+                index = index + 1;
+            }
+        }
+
+        return probability;
+    }
+
+  private:
+    struct node {
+        light_bounds bounds;
+        int offset;  // Leaves: index of the light. Interior nodes: index of the second child,
+                     // the first child being stored right after the node.
+        bool leaf;
+    };
+
+    struct build_item {
+        light_bounds bounds;
+        point3 centroid;
+        int light;
+    };
+
+    std::vector<shared_ptr<hittable>> lights;
+    std::vector<node> nodes;
+
+    // For each light, the path from the root to its leaf: bit k is set if the path takes the
+    // second child at depth k. Sorted by light address.
+    std::vector<std::pair<const hittable*, uint64_t>> trails;
+
+    int build(std::vector<build_item>& items, size_t start, size_t end, uint64_t trail,
+              int depth) {
+        int index = int(nodes.size());
+        nodes.push_back(node{});
+
+        if (end - start == 1) {
+            nodes[index] = node{items[start].bounds, items[start].light, true};
+            trails.emplace_back(lights[items[start].light].get(), trail);
+            return index;
+        }
+
+        // Split at the median centroid along the longest axis of the centroids. The tree stays
+        // balanced, so its depth (and the length of a trail) is the log of the light count.
+        aabb centroid_box;
+        for (size_t i = start; i < end; i++)
+            centroid_box = aabb(centroid_box, aabb(items[i].centroid, items[i].centroid));
+        int axis = centroid_box.longest_axis();
+
+        auto mid = start + (end - start) / 2;
+        std::nth_element(items.begin() + start, items.begin() + mid, items.begin() + end,
+            [axis](const build_item& a, const build_item& b) {
+                return a.centroid[axis] < b.centroid[axis];
+            });
+
+        build(items, start, mid, trail, depth + 1);
+        int second = build(items, mid, end, trail | (uint64_t(1) << depth), depth + 1);
+
+        nodes[index].bounds = light_bounds(nodes[index + 1].bounds, nodes[second].bounds);
+        nodes[index].offset = second;
+        nodes[index].leaf = false;
+        return index;
+    }
+
+    std::vector<std::pair<const hittable*, uint64_t>>::const_iterator
+    find_trail(const hittable* light) const {
+        auto it = std::lower_bound(trails.begin(), trails.end(), light,
+            [](const std::pair<const hittable*, uint64_t>& entry, const hittable* key) {
+                return entry.first < key;
+            });
+        return (it != trails.end() && it->first == light) ? it : trails.end();
+    }
+};
+
+
+#endif
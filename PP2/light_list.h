@@ -0,0 +1,81 @@
+#ifndef LIGHT_LIST_H
+#define LIGHT_LIST_H
+//==============================================================================================
+// To the extent possible under law, the author(s) have dedicated all copyright and related and
+// neighboring rights to this software to the public domain worldwide. This software is
+// distributed without any warranty.
+//
+// You should have received a copy (see file COPYING.txt) of the CC0 Public Domain Dedication
+// along with this software. If not, see <http://creativecommons.org/publicdomain/zero/1.0/>.
+//==============================================================================================
+
+#include "hittable_list.h"
+#include "light_sampler.h"
+#include "material.h"
+
+#include <algorithm>
+#include <vector>
+
+
+class light_list : public light_sampler {
+  public:
+    // The shapes that camera::render() samples explicitly as light sources, each picked with
+    // the same probability wherever it is sampled from. Suits scenes with a few lights; see
+    // light_bvh for scenes with many.
+
+    light_list() {}
+
+    light_list(const hittable_list& world) {
+        // Collects the emissive lights of a scene list (and of lists nested in it), including
+        // emitters placed by a transform. Build this before the list is wrapped in a BVH, since
+        // the lights inside a BVH are not visited, and neither are the instances of an
+        // instance_bvh. Lights that are not collected are still found by scattered rays, with
+        // their emission counted in full, so they only add noise.
+        collect(world);
+    }
+
+    void add(shared_ptr<hittable> light) {
+        lights.push_back(light);
+        sorted.insert(std::upper_bound(sorted.begin(), sorted.end(), light.get()), light.get());
+    }
+
+    bool empty() const override { return lights.empty(); }
+    size_t size() const { return lights.size(); }
+
+    const std::vector<shared_ptr<hittable>>& objects() const { return lights; }
+
+    bool contains(const hittable* object) const override {
+        return std::binary_search(sorted.begin(), sorted.end(), object);
+    }
+
+    const hittable* sample(const point3&, const vec3&, double& probability) const override {
+        if (lights.empty())
+            return nullptr;
+        probability = 1.0 / lights.size();
+        return lights[std::min(size_t(random_double() * lights.size()), lights.size() - 1)].get();
+    }
+
+    double probability(const point3&, const vec3&, const hittable* light) const override {
+        return contains(light) ? 1.0 / lights.size() : 0.0;
+    }
+
+  private:
+    std::vector<shared_ptr<hittable>> lights;
+    std::vector<const hittable*> sorted;  // The lights' addresses, for contains()
+
+    void collect(const hittable_list& list) {
+        for (const auto& object : list.objects) {
+            if (auto nested = std::dynamic_pointer_cast<hittable_list>(object)) {
+                collect(*nested);
+                continue;
+            }
+
+            auto mat = object->light_material();
+            if (mat && mat->is_emissive())
+                add(object);
+        }
+    }
+};
+
+
+#endif
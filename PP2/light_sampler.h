@@ -0,0 +1,45 @@
+#ifndef LIGHT_SAMPLER_H
+#define LIGHT_SAMPLER_H
+//==============================================================================================
+// To the extent possible under law, the author(s) have dedicated all copyright and related and
+// neighboring rights to this software to the public domain worldwide. This software is
+// distributed without any warranty.
+//
+// You should have received a copy (see file COPYING.txt) of the CC0 Public Domain Dedication
+// along with this software. If not, see <http://creativecommons.org/publicdomain/zero/1.0/>.
+//==============================================================================================
+
+#include "hittable.h"
+
+
+class light_sampler {
+  public:
+    // Chooses which of a scene's lights camera::render() samples at each shading point. Every
+    // light must implement hittable::pdf_value() and hittable::random(), and also be part of
+    // the world so that shadow rays and scattered rays can hit it. Emitters that are not among
+    // the lights are only found by scattered rays, which keeps the image unbiased but noisier.
+    //
+    // The shading point is given by its position p and surface normal n. A zero normal means
+    // the point is not on a surface (as in a participating medium), so lights in any direction
+    // from it matter.
+
+    virtual ~light_sampler() = default;
+
+    virtual bool empty() const = 0;
+
+    // True if the object is one of the lights, which tells a renderer that light reaching a
+    // surface from it has already been accounted for by sampling.
+    virtual bool contains(const hittable* object) const = 0;
+
+    // Picks a light to sample from the shading point, and returns the probability of that
+    // pick, or returns nullptr if no light is worth sampling from there.
+    virtual const hittable* sample(const point3& p, const vec3& n, double& probability) const
+        = 0;
+
+    // The probability that sample() picks the given light from the shading point.
+    virtual double probability(const point3& p, const vec3& n, const hittable* light) const
+        = 0;
+};
+
+
+#endif
@@ -0,0 +1,439 @@
+#ifndef LINEAR_BVH_H
+#define LINEAR_BVH_H
+//==============================================================================================
+// To the extent possible under law, the author(s) have dedicated all copyright and related and
+// neighboring rights to this software to the public domain worldwide. This software is
+// distributed without any warranty.
+//
+// You should have received a copy (see file COPYING.txt) of the CC0 Public Domain Dedication
+// along with this software. If not, see <http://creativecommons.org/publicdomain/zero/1.0/>.
+//==============================================================================================
+
+#include "aabb.h"
+#include "bvh.h"
+#include "hittable.h"
+#include "hittable_list.h"
+#include "quad_packet.h"
+#include "sphere_packet.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <numeric>
+#include <vector>
+
+
+class alignas(64) linear_bvh_node {
+  public:
+    // One node of a flattened BVH, padded to a 64-byte cache line. Nodes are laid out depth
+    // first, so an interior node's first child always directly follows it in the array.
+
+    aabb     bbox;
+    int32_t  offset = 0;  // Leaf: index of the first primitive. Interior: second child index.
+    uint16_t count = 0;   // Number of primitives in a leaf; zero for interior nodes
+    uint8_t  axis = 0;    // Axis along which an interior node's children are ordered
+};
+
+static_assert(sizeof(linear_bvh_node) == 64, "linear_bvh_node should fill one cache line");
+
+
+// Recursion depth past which the builder stops using the SAH and splits at the median, so the
+// tree depth (and with it the traversal stack) stays bounded whatever the input.
+const int linear_bvh_sah_depth_limit = 32;
+const int linear_bvh_max_depth = 64;
+
+
+inline double build_linear_bvh_node(
+    const std::vector<aabb>& boxes, const bvh_build_options& options, int max_leaf_size,
+    std::vector<linear_bvh_node>& nodes, std::vector<int>& order,
+    size_t start, size_t end, int depth
+) {
+    // Builds the subtree over primitives order[start, end) and returns its SAH cost.
+
+    auto box_of = [&](int primitive) -> const aabb& { return boxes[primitive]; };
+
+    auto bbox = aabb::empty;
+    for (size_t i = start; i < end; i++)
+        bbox = aabb(bbox, boxes[order[i]]);
+
+    auto index = nodes.size();
+    nodes.emplace_back();
+    nodes[index].bbox = bbox;
+
+    size_t count = end - start;
+    size_t packet_width = std::max(1, options.packet_width);
+    auto leaf_cost = ((count + packet_width - 1) / packet_width) * options.intersection_cost;
+    auto make_leaf = [&] {
+        nodes[index].offset = int32_t(start);
+        nodes[index].count = uint16_t(count);
+        return leaf_cost;
+    };
+
+    if (count == 1)
+        return make_leaf();
+
+    size_t mid = start;
+    if (options.split == bvh_split_method::sah && depth < linear_bvh_sah_depth_limit) {
+        double split_cost;
+        mid = sah_partition(order, start, end, bbox, box_of, options, split_cost);
+        if (int(count) <= max_leaf_size && (mid == start || leaf_cost <= split_cost))
+            return make_leaf();
+    } else if (int(count) <= max_leaf_size) {
+        return make_leaf();
+    }
+
+    if (mid == start) {
+        int axis = bbox.longest_axis();
+        mid = start + count/2;
+        std::nth_element(
+            std::begin(order) + start, std::begin(order) + mid, std::begin(order) + end,
+            [&](int a, int b) {
+                const auto& ia = boxes[a].axis_interval(axis);
+                const auto& ib = boxes[b].axis_interval(axis);
+                return ia.min + ia.max < ib.min + ib.max;
+            });
+    }
+
+    auto left_cost = build_linear_bvh_node(
+        boxes, options, max_leaf_size, nodes, order, start, mid, depth + 1);
+    auto second = nodes.size();
+    auto right_cost = build_linear_bvh_node(
+        boxes, options, max_leaf_size, nodes, order, mid, end, depth + 1);
+
+    // Order the children along the axis that separates their centers the most, which is the
+    // axis traversal uses to decide which child is nearer to the ray.
+    const auto& left_box = nodes[index + 1].bbox;
+    const auto& right_box = nodes[second].bbox;
+    int axis = 0;
+    double separation = -1;
+    for (int a = 0; a < 3; a++) {
+        const auto& l = left_box.axis_interval(a);
+        const auto& r = right_box.axis_interval(a);
+        auto d = std::fabs((r.min + r.max) - (l.min + l.max));
+        if (d > separation) {
+            separation = d;
+            axis = a;
+        }
+    }
+
+    auto& node = nodes[index];
+    node.offset = int32_t(second);
+    node.axis = uint8_t(axis);
+
+    // The first child must be the one with the smaller coordinates along the axis.
+    const auto& l = left_box.axis_interval(axis);
+    const auto& r = right_box.axis_interval(axis);
+    bool swapped = (l.min + l.max) > (r.min + r.max);
+    if (swapped)
+        node.axis |= 4;  // Bit 2 flags that the far-side child comes first in memory
+
+    auto area = bbox.surface_area();
+    if (area <= 0)
+        return options.traversal_cost + left_cost + right_cost;
+
+    return options.traversal_cost
+         + (left_box.surface_area()*left_cost + right_box.surface_area()*right_cost) / area;
+}
+
+
+inline double build_linear_bvh(
+    const std::vector<aabb>& boxes, const bvh_build_options& options, int max_leaf_size,
+    std::vector<linear_bvh_node>& nodes, std::vector<int>& order
+) {
+    // Builds a flattened BVH over the given primitive bounding boxes. On return, order lists
+    // the primitive indices in leaf order (each leaf covers a contiguous run of it), and the
+    // SAH cost of the tree is returned.
+
+    nodes.clear();
+    order.resize(boxes.size());
+    std::iota(order.begin(), order.end(), 0);
+
+    if (boxes.empty())
+        return 0;
+
+    max_leaf_size = std::max(1, std::min(max_leaf_size, 255));
+    nodes.reserve(2 * boxes.size());
+    return build_linear_bvh_node(boxes, options, max_leaf_size, nodes, order, 0, boxes.size(), 0);
+}
+
+
+template <typename NodeHit, typename LeafHit>
+bool traverse_linear_bvh(
+    const std::vector<linear_bvh_node>& nodes, const ray& r, interval& ray_t,
+    NodeHit node_hit, LeafHit leaf_hit
+) {
+    // Walks the tree with an explicit stack, visiting the child nearer to the ray origin
+    // first. node_hit(index, ray_t) decides whether the ray enters a node's bounds.
+    // leaf_hit(first, count, ray_t) tests the primitives of a leaf and must return true,
+    // after shrinking ray_t.max to the hit distance, if it found a closer hit.
+
+    if (nodes.empty())
+        return false;
+
+    int stack[linear_bvh_max_depth];
+    int stack_size = 0;
+    int current = 0;
+    bool hit_anything = false;
+
+    while (true) {
+        const auto& node = nodes[current];
+
+        if (node_hit(current, ray_t)) {
+            if (node.count > 0) {
+                if (leaf_hit(node.offset, node.count, ray_t))
+                    hit_anything = true;
+            } else {
+                bool far_first = r.is_negative(node.axis & 3) != bool(node.axis & 4);
+                if (far_first) {
+                    stack[stack_size++] = current + 1;
+                    current = node.offset;
+                } else {
+                    stack[stack_size++] = node.offset;
+                    current = current + 1;
+                }
+                continue;
+            }
+        }
+
+        if (stack_size == 0)
+            break;
+        current = stack[--stack_size];
+    }
+
+    return hit_anything;
+}
+
+
+template <typename LeafHit>
+bool traverse_linear_bvh(
+    const std::vector<linear_bvh_node>& nodes, const ray& r, interval& ray_t, LeafHit leaf_hit
+) {
+    // Traversal against the static node bounds.
+    return traverse_linear_bvh(nodes, r, ray_t,
+        [&](int index, const interval& t) { return nodes[index].bbox.hit(r, t); },
+        leaf_hit);
+}
+
+
+template <typename NodeHit, typename LeafOccluded>
+bool occluded_linear_bvh(
+    const std::vector<linear_bvh_node>& nodes, const ray& r, const interval& ray_t,
+    NodeHit node_hit, LeafOccluded leaf_occluded
+) {
+    // Any-hit walk of the tree for occlusion queries: returns true as soon as
+    // leaf_occluded(first, count, ray_t) finds a hit in some leaf. The interval never shrinks,
+    // so the order children are visited in only matters for how soon a hit is found.
+
+    if (nodes.empty())
+        return false;
+
+    int stack[linear_bvh_max_depth];
+    int stack_size = 0;
+    int current = 0;
+
+    while (true) {
+        const auto& node = nodes[current];
+
+        if (node_hit(current, ray_t)) {
+            if (node.count > 0) {
+                if (leaf_occluded(node.offset, node.count, ray_t))
+                    return true;
+            } else {
+                bool far_first = r.is_negative(node.axis & 3) != bool(node.axis & 4);
+                stack[stack_size++] = far_first ? current + 1 : node.offset;
+                current = far_first ? node.offset : current + 1;
+                continue;
+            }
+        }
+
+        if (stack_size == 0)
+            return false;
+        current = stack[--stack_size];
+    }
+}
+
+
+template <typename LeafOccluded>
+bool occluded_linear_bvh(
+    const std::vector<linear_bvh_node>& nodes, const ray& r, const interval& ray_t,
+    LeafOccluded leaf_occluded
+) {
+    // Occlusion walk against the static node bounds.
+    return occluded_linear_bvh(nodes, r, ray_t,
+        [&](int index, const interval& t) { return nodes[index].bbox.hit(r, t); },
+        leaf_occluded);
+}
+
+
+class linear_bvh : public hittable {
+  public:
+    // Plain quads and spheres in a leaf are gathered into SIMD packets and tested together;
+    // the rest of the leaf's primitives are tested one at a time after them.
+
+    linear_bvh(const hittable_list& list, const bvh_build_options& options = sah_options(),
+               int max_leaf_size = 4)
+    {
+        auto start_time = std::chrono::steady_clock::now();
+
+        std::vector<aabb> boxes;
+        boxes.reserve(list.objects.size());
+        size_t packable = 0;
+        for (const auto& object : list.objects) {
+            boxes.push_back(object->bounding_box());
+            if (quad_packet::packable(*object) || sphere_packet::packable(*object)) packable++;
+        }
+
+        // When the list is mostly packable shapes, let the builder make leaves that fill
+        // whole packets.
+        auto build_options = options;
+        if (2 * packable > list.objects.size())
+            build_options.packet_width = quad_packet::width;
+
+        std::vector<int> order;
+        auto cost = build_linear_bvh(boxes, build_options, max_leaf_size, nodes, order);
+
+        // Store the primitives in leaf order, so that a leaf references a contiguous range.
+        primitives.reserve(order.size());
+        for (auto index : order)
+            primitives.push_back(list.objects[index]);
+
+        build_packets();
+
+        std::chrono::duration<double, std::milli> elapsed =
+            std::chrono::steady_clock::now() - start_time;
+
+        std::clog << "Linear BVH (" << (options.split == bvh_split_method::sah ? "SAH" : "median")
+                  << "): " << primitives.size() << " objects, " << nodes.size() << " nodes, "
+                  << quad_packets.size() << " quad and " << sphere_packets.size()
+                  << " sphere packets, SAH cost " << cost << ", built in "
+                  << elapsed.count() << " ms\n";
+    }
+
+    bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
+        return traverse_linear_bvh(nodes, r, ray_t,
+            [&](int first, int count, interval& t) {
+                hit_record temp_rec;
+                bool hit_anything = false;
+
+                const auto& leaf = leaf_packets[first];
+                auto quads_end = leaf.first_quad_packet + leaf.quad_packet_count;
+                for (int p = leaf.first_quad_packet; p < quads_end; p++) {
+                    if (quad_packets[p].hit(r, t, rec)) {
+                        hit_anything = true;
+                        t.max = rec.t;
+                    }
+                }
+
+                auto spheres_end = leaf.first_sphere_packet + leaf.sphere_packet_count;
+                for (int p = leaf.first_sphere_packet; p < spheres_end; p++) {
+                    if (sphere_packets[p].hit(r, t, rec)) {
+                        hit_anything = true;
+                        t.max = rec.t;
+                    }
+                }
+
+                for (int i = first + leaf.packed_count; i < first + count; i++) {
+                    if (primitives[i]->hit(r, t, temp_rec)) {
+                        hit_anything = true;
+                        t.max = temp_rec.t;
+                        rec = temp_rec;
+                    }
+                }
+                return hit_anything;
+            });
+    }
+
+    bool occluded(const ray& r, interval ray_t) const override {
+        return occluded_linear_bvh(nodes, r, ray_t,
+            [&](int first, int count, const interval& t) {
+                const auto& leaf = leaf_packets[first];
+                auto quads_end = leaf.first_quad_packet + leaf.quad_packet_count;
+                for (int p = leaf.first_quad_packet; p < quads_end; p++) {
+                    if (quad_packets[p].occluded(r, t))
+                        return true;
+                }
+
+                auto spheres_end = leaf.first_sphere_packet + leaf.sphere_packet_count;
+                for (int p = leaf.first_sphere_packet; p < spheres_end; p++) {
+                    if (sphere_packets[p].occluded(r, t))
+                        return true;
+                }
+
+                for (int i = first + leaf.packed_count; i < first + count; i++) {
+                    if (primitives[i]->occluded(r, t))
+                        return true;
+                }
+                return false;
+            });
+    }
+
+    aabb bounding_box() const override {
+        return nodes.empty() ? aabb::empty : nodes[0].bbox;
+    }
+
+    static bvh_build_options sah_options() {
+        bvh_build_options options;
+        options.split = bvh_split_method::sah;
+        return options;
+    }
+
+  private:
+    class leaf_packet_range {
+      public:
+        int32_t  first_quad_packet = 0;
+        int32_t  first_sphere_packet = 0;
+        uint16_t quad_packet_count = 0;
+        uint16_t sphere_packet_count = 0;
+        uint16_t packed_count = 0;  // The leaf's first packed_count primitives are in packets
+    };
+
+    std::vector<shared_ptr<hittable>> primitives;
+    std::vector<linear_bvh_node> nodes;
+    std::vector<quad_packet> quad_packets;
+    std::vector<sphere_packet> sphere_packets;
+    std::vector<leaf_packet_range> leaf_packets;  // Indexed by the leaf's first primitive
+
+    void build_packets() {
+        leaf_packets.assign(primitives.size(), leaf_packet_range());
+
+        for (const auto& node : nodes) {
+            if (node.count == 0)
+                continue;
+
+            // Order the leaf's range as quads, then spheres, then everything else.
+            auto begin = primitives.begin() + node.offset;
+            auto end = begin + node.count;
+            auto quads_end = std::stable_partition(begin, end,
+                [](const shared_ptr<hittable>& object) { return quad_packet::packable(*object); });
+            auto spheres_end = std::stable_partition(quads_end, end,
+                [](const shared_ptr<hittable>& obj) { return sphere_packet::packable(*obj); });
+
+            auto& leaf = leaf_packets[node.offset];
+            leaf.first_quad_packet = int32_t(quad_packets.size());
+            leaf.quad_packet_count = pack<quad>(begin, quads_end, quad_packets);
+            leaf.first_sphere_packet = int32_t(sphere_packets.size());
+            leaf.sphere_packet_count = pack<sphere>(quads_end, spheres_end, sphere_packets);
+            leaf.packed_count = uint16_t(spheres_end - begin);
+        }
+    }
+
+    template <typename Shape, typename Packet>
+    static uint16_t pack(
+        std::vector<shared_ptr<hittable>>::iterator begin,
+        std::vector<shared_ptr<hittable>>::iterator end, std::vector<Packet>& packets
+    ) {
+        // Appends packets holding the shapes in [begin, end) and returns how many it added.
+        uint16_t added = 0;
+        for (auto it = begin; it != end; ++it) {
+            if (added == 0 || packets.back().size() == Packet::width) {
+                packets.emplace_back();
+                added++;
+            }
+            packets.back().add(static_cast<const Shape&>(**it));
+        }
+        return added;
+    }
+};
+
+
+#endif
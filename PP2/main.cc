@@ -2,15 +2,20 @@
 // As biblotecas foram implementadas por Peter Shirley em 2016!
 
 #include "rtweekend.h"
+#include "aabb_box.h"
 #include "bvh.h"
 #include "camera.h"
 #include "constant_medium.h"
 #include "hittable.h"
 #include "hittable_list.h"
+#include "instance_bvh.h"
+#include "light_list.h"
+#include "linear_bvh.h"
 #include "material.h"
 #include "quad.h"
 #include "texture.h"
 #include "sphere.h"
+#include "voxel_grid.h"
 
 // Função para configurar e renderizar a cena
 void scene_with_textured_cubes() {
@@ -45,19 +50,11 @@ void scene_with_textured_cubes() {
             float x = col * (cubo_size + cubo_spacing);
             float z = row * (cubo_size + cubo_spacing);
 
-            // Adicionar blocos de terra em todas as posições
-            // Frente
-            world.add(make_shared<quad>(point3(x, 0, z), vec3(cubo_size, 0, 0), vec3(0, cubo_size, 0), side_material));
-            // Traseira
-            world.add(make_shared<quad>(point3(x, 0, z + cubo_size), vec3(cubo_size, 0, 0), vec3(0, cubo_size, 0), side_material));
-            // Esquerda
-            world.add(make_shared<quad>(point3(x, 0, z), vec3(0, 0, cubo_size), vec3(0, cubo_size, 0), side_material));
-            // Direita
-            world.add(make_shared<quad>(point3(x + cubo_size, 0, z), vec3(0, 0, cubo_size), vec3(0, cubo_size, 0), side_material));
-            // Topo
-            world.add(make_shared<quad>(point3(x, cubo_size, z), vec3(cubo_size, 0, 0), vec3(0, 0, cubo_size), top_material));
-            // Base
-            world.add(make_shared<quad>(point3(x, 0, z), vec3(cubo_size, 0, 0), vec3(0, 0, cubo_size), side_material));
+            // Adicionar blocos de terra em todas as posições, cada um como uma única caixa
+            // (frente, traseira, esquerda, direita, topo e base)
+            world.add(make_shared<aabb_box>(
+                point3(x, 0, z), point3(x + cubo_size, cubo_size, z + cubo_size),
+                side_material, side_material, side_material, side_material, top_material, side_material));
         }
     }
 
@@ -80,22 +77,20 @@ void scene_with_textured_cubes() {
     float z_above = 0 * (cubo_size + cubo_spacing); // Z do canto superior direito
     float y_above = cubo_size;                      // Altura do baú (em cima do bloco de terra)
 
-    // Adicionar os lados do cubo do baú
-    world.add(make_shared<quad>(point3(x_above, y_above, z_above), vec3(cubo_size, 0, 0), vec3(0, cubo_size, 0), side_material_new)); // Frente
-    world.add(make_shared<quad>(point3(x_above, y_above, z_above + cubo_size), vec3(cubo_size, 0, 0), vec3(0, cubo_size, 0), front_material_new)); // Traseira
-    world.add(make_shared<quad>(point3(x_above, y_above, z_above), vec3(0, 0, cubo_size), vec3(0, cubo_size, 0), side_material_new)); // Esquerda
-    world.add(make_shared<quad>(point3(x_above + cubo_size, y_above, z_above), vec3(0, 0, cubo_size), vec3(0, cubo_size, 0), side_material_new)); // Direita
-    world.add(make_shared<quad>(point3(x_above, y_above + cubo_size, z_above), vec3(cubo_size, 0, 0), vec3(0, 0, cubo_size), top_material_new)); // Topo
+    // Adicionar o cubo do baú, com a frente voltada para a câmera (+Z)
+    world.add(make_shared<aabb_box>(
+        point3(x_above, y_above, z_above), point3(x_above + cubo_size, y_above + cubo_size, z_above + cubo_size),
+        front_material_new, side_material_new, side_material_new, side_material_new, top_material_new, side_material_new));
 
     // Adicionar a árvore no canto inferior esquerdo e centralizar no bloco
     point3 tree_base(0.5 * cubo_size, cubo_size, 2.5 * (cubo_size + cubo_spacing)); // Posição mais centralizada no bloco de terra
-    world.add(box(tree_base + vec3(-0.1, 0, -0.1), tree_base + vec3(0.1, 1.2, 0.1), wood)); // Tronco da árvore, agora centralizado
-    world.add(box(tree_base + vec3(-0.4, 1.2, -0.4), tree_base + vec3(0.4, 1.6, 0.4), leaves));  // Folhas inferior
-    world.add(box(tree_base + vec3(-0.3, 1.6, -0.3), tree_base + vec3(0.3, 1.9, 0.3), leaves));  // Folhas intermediária
-    world.add(box(tree_base + vec3(-0.2, 1.9, -0.2), tree_base + vec3(0.2, 2.1, 0.2), leaves));  // Folhas superior
+    world.add(make_shared<aabb_box>(tree_base + vec3(-0.1, 0, -0.1), tree_base + vec3(0.1, 1.2, 0.1), wood)); // Tronco da árvore, agora centralizado
+    world.add(make_shared<aabb_box>(tree_base + vec3(-0.4, 1.2, -0.4), tree_base + vec3(0.4, 1.6, 0.4), leaves));  // Folhas inferior
+    world.add(make_shared<aabb_box>(tree_base + vec3(-0.3, 1.6, -0.3), tree_base + vec3(0.3, 1.9, 0.3), leaves));  // Folhas intermediária
+    world.add(make_shared<aabb_box>(tree_base + vec3(-0.2, 1.9, -0.2), tree_base + vec3(0.2, 2.1, 0.2), leaves));  // Folhas superior
 
     // Adicionar uma fonte de luz emissiva (simulação de luz)
-    auto light_material = make_shared<lambertian>(color(4, 4, 4)); // Luz mais brilhante
+    auto light_material = make_shared<diffuse_light>(color(4, 4, 4)); // Luz mais brilhante
     world.add(make_shared<sphere>(point3(5, 5, -5), 1.0, light_material)); // Luz vinda da direita
 
     // Configuração da câmera
@@ -110,9 +105,20 @@ void scene_with_textured_cubes() {
     cam.lookat = point3(1.5, 1, 1.5); // Centralizado na formação
     cam.vup = vec3(0, 1, 0);
     cam.defocus_angle = 0;
+    cam.output_file = "final_scene1.png"; // Grava a imagem diretamente em PNG
+    cam.sampling = sampler_method::sobol; // Amostras bem distribuídas: menos ruído por amostra
+
+    // Amostragem explícita das luzes combinada com a da BSDF (MIS): cada acerto não especular
+    // lança um raio de sombra até a esfera emissiva. As luzes são coletadas antes de a lista
+    // virar uma BVH.
+    cam.integrator = integrator_method::mis;
+    light_list lights(world);
+
+    // Organiza os objetos em uma BVH linear para acelerar a interseção dos raios
+    world = hittable_list(make_shared<linear_bvh>(world));
 
     // Renderizar a cena
-    cam.render(world);
+    cam.render(world, lights);
 }
 
 // Função para configurar e renderizar a cena
@@ -148,19 +154,11 @@ void scene_with_inverted_spheres() {
             float x = col * (cubo_size + cubo_spacing);
             float z = row * (cubo_size + cubo_spacing);
 
-            // Adicionar blocos de terra em todas as posições
-            // Frente
-            world.add(make_shared<quad>(point3(x, 0, z), vec3(cubo_size, 0, 0), vec3(0, cubo_size, 0), side_material));
-            // Traseira
-            world.add(make_shared<quad>(point3(x, 0, z + cubo_size), vec3(cubo_size, 0, 0), vec3(0, cubo_size, 0), side_material));
-            // Esquerda
-            world.add(make_shared<quad>(point3(x, 0, z), vec3(0, 0, cubo_size), vec3(0, cubo_size, 0), side_material));
-            // Direita
-            world.add(make_shared<quad>(point3(x + cubo_size, 0, z), vec3(0, 0, cubo_size), vec3(0, cubo_size, 0), side_material));
-            // Topo
-            world.add(make_shared<quad>(point3(x, cubo_size, z), vec3(cubo_size, 0, 0), vec3(0, 0, cubo_size), top_material));
-            // Base
-            world.add(make_shared<quad>(point3(x, 0, z), vec3(cubo_size, 0, 0), vec3(0, 0, cubo_size), side_material));
+            // Adicionar blocos de terra em todas as posições, cada um como uma única caixa
+            // (frente, traseira, esquerda, direita, topo e base)
+            world.add(make_shared<aabb_box>(
+                point3(x, 0, z), point3(x + cubo_size, cubo_size, z + cubo_size),
+                side_material, side_material, side_material, side_material, top_material, side_material));
         }
     }
 
@@ -183,22 +181,20 @@ void scene_with_inverted_spheres() {
     float z_above = 0 * (cubo_size + cubo_spacing); // Z do canto superior direito
     float y_above = cubo_size;                      // Altura do baú (em cima do bloco de terra)
 
-    // Adicionar os lados do cubo do baú
-    world.add(make_shared<quad>(point3(x_above, y_above, z_above), vec3(cubo_size, 0, 0), vec3(0, cubo_size, 0), side_material_new)); // Frente
-    world.add(make_shared<quad>(point3(x_above, y_above, z_above + cubo_size), vec3(cubo_size, 0, 0), vec3(0, cubo_size, 0), front_material_new)); // Traseira
-    world.add(make_shared<quad>(point3(x_above, y_above, z_above), vec3(0, 0, cubo_size), vec3(0, cubo_size, 0), side_material_new)); // Esquerda
-    world.add(make_shared<quad>(point3(x_above + cubo_size, y_above, z_above), vec3(0, 0, cubo_size), vec3(0, cubo_size, 0), side_material_new)); // Direita
-    world.add(make_shared<quad>(point3(x_above, y_above + cubo_size, z_above), vec3(cubo_size, 0, 0), vec3(0, 0, cubo_size), top_material_new)); // Topo
+    // Adicionar o cubo do baú, com a frente voltada para a câmera (+Z)
+    world.add(make_shared<aabb_box>(
+        point3(x_above, y_above, z_above), point3(x_above + cubo_size, y_above + cubo_size, z_above + cubo_size),
+        front_material_new, side_material_new, side_material_new, side_material_new, top_material_new, side_material_new));
 
     // Adicionar a árvore no canto inferior esquerdo e centralizar no bloco
     point3 tree_base(0.5 * cubo_size, cubo_size, 2.5 * (cubo_size + cubo_spacing)); // Posição mais centralizada no bloco de terra
-    world.add(box(tree_base + vec3(-0.1, 0, -0.1), tree_base + vec3(0.1, 1.2, 0.1), wood)); // Tronco da árvore, agora centralizado
-    world.add(box(tree_base + vec3(-0.4, 1.2, -0.4), tree_base + vec3(0.4, 1.6, 0.4), leaves));  // Folhas inferior
-    world.add(box(tree_base + vec3(-0.3, 1.6, -0.3), tree_base + vec3(0.3, 1.9, 0.3), leaves));  // Folhas intermediária
-    world.add(box(tree_base + vec3(-0.2, 1.9, -0.2), tree_base + vec3(0.2, 2.1, 0.2), leaves));  // Folhas superior
+    world.add(make_shared<aabb_box>(tree_base + vec3(-0.1, 0, -0.1), tree_base + vec3(0.1, 1.2, 0.1), wood)); // Tronco da árvore, agora centralizado
+    world.add(make_shared<aabb_box>(tree_base + vec3(-0.4, 1.2, -0.4), tree_base + vec3(0.4, 1.6, 0.4), leaves));  // Folhas inferior
+    world.add(make_shared<aabb_box>(tree_base + vec3(-0.3, 1.6, -0.3), tree_base + vec3(0.3, 1.9, 0.3), leaves));  // Folhas intermediária
+    world.add(make_shared<aabb_box>(tree_base + vec3(-0.2, 1.9, -0.2), tree_base + vec3(0.2, 2.1, 0.2), leaves));  // Folhas superior
 
     // Adicionar uma fonte de luz emissiva (simulação de luz)
-    auto light_material = make_shared<lambertian>(color(4, 4, 4)); // Luz mais brilhante
+    auto light_material = make_shared<diffuse_light>(color(4, 4, 4)); // Luz mais brilhante
     world.add(make_shared<sphere>(point3(5, 5, -5), 1.0, light_material)); // Luz vinda da direita
 
     // Configuração da câmera
@@ -213,9 +209,20 @@ void scene_with_inverted_spheres() {
     cam.lookat = point3(1.5, 1, 1.5); // Centralizado na formação
     cam.vup = vec3(0, 1, 0);
     cam.defocus_angle = 0;
+    cam.output_file = "final_scene2.png"; // Grava a imagem diretamente em PNG
+    cam.sampling = sampler_method::sobol; // Amostras bem distribuídas: menos ruído por amostra
+
+    // Amostragem explícita das luzes combinada com a da BSDF (MIS): cada acerto não especular
+    // lança um raio de sombra até a esfera emissiva. As luzes são coletadas antes de a lista
+    // virar uma BVH.
+    cam.integrator = integrator_method::mis;
+    light_list lights(world);
+
+    // Organiza os objetos em uma BVH linear para acelerar a interseção dos raios
+    world = hittable_list(make_shared<linear_bvh>(world));
 
     // Renderizar a cena
-    cam.render(world);
+    cam.render(world, lights);
 }
 
 // Função para configurar e renderizar a cena
@@ -251,19 +258,11 @@ void scene_with_different_cam() {
             float x = col * (cubo_size + cubo_spacing);
             float z = row * (cubo_size + cubo_spacing);
 
-            // Adicionar blocos de terra em todas as posições
-            // Frente
-            world.add(make_shared<quad>(point3(x, 0, z), vec3(cubo_size, 0, 0), vec3(0, cubo_size, 0), side_material));
-            // Traseira
-            world.add(make_shared<quad>(point3(x, 0, z + cubo_size), vec3(cubo_size, 0, 0), vec3(0, cubo_size, 0), side_material));
-            // Esquerda
-            world.add(make_shared<quad>(point3(x, 0, z), vec3(0, 0, cubo_size), vec3(0, cubo_size, 0), side_material));
-            // Direita
-            world.add(make_shared<quad>(point3(x + cubo_size, 0, z), vec3(0, 0, cubo_size), vec3(0, cubo_size, 0), side_material));
-            // Topo
-            world.add(make_shared<quad>(point3(x, cubo_size, z), vec3(cubo_size, 0, 0), vec3(0, 0, cubo_size), top_material));
-            // Base
-            world.add(make_shared<quad>(point3(x, 0, z), vec3(cubo_size, 0, 0), vec3(0, 0, cubo_size), side_material));
+            // Adicionar blocos de terra em todas as posições, cada um como uma única caixa
+            // (frente, traseira, esquerda, direita, topo e base)
+            world.add(make_shared<aabb_box>(
+                point3(x, 0, z), point3(x + cubo_size, cubo_size, z + cubo_size),
+                side_material, side_material, side_material, side_material, top_material, side_material));
         }
     }
 
@@ -286,22 +285,20 @@ void scene_with_different_cam() {
     float z_above = 0 * (cubo_size + cubo_spacing); // Z do canto superior direito
     float y_above = cubo_size;                      // Altura do baú (em cima do bloco de terra)
 
-    // Adicionar os lados do cubo do baú
-    world.add(make_shared<quad>(point3(x_above, y_above, z_above), vec3(cubo_size, 0, 0), vec3(0, cubo_size, 0), side_material_new)); // Frente
-    world.add(make_shared<quad>(point3(x_above, y_above, z_above + cubo_size), vec3(cubo_size, 0, 0), vec3(0, cubo_size, 0), front_material_new)); // Traseira
-    world.add(make_shared<quad>(point3(x_above, y_above, z_above), vec3(0, 0, cubo_size), vec3(0, cubo_size, 0), side_material_new)); // Esquerda
-    world.add(make_shared<quad>(point3(x_above + cubo_size, y_above, z_above), vec3(0, 0, cubo_size), vec3(0, cubo_size, 0), side_material_new)); // Direita
-    world.add(make_shared<quad>(point3(x_above, y_above + cubo_size, z_above), vec3(cubo_size, 0, 0), vec3(0, 0, cubo_size), top_material_new)); // Topo
+    // Adicionar o cubo do baú, com a frente voltada para a câmera (+Z)
+    world.add(make_shared<aabb_box>(
+        point3(x_above, y_above, z_above), point3(x_above + cubo_size, y_above + cubo_size, z_above + cubo_size),
+        front_material_new, side_material_new, side_material_new, side_material_new, top_material_new, side_material_new));
 
     // Adicionar a árvore no canto inferior esquerdo e centralizar no bloco
     point3 tree_base(0.5 * cubo_size, cubo_size, 2.5 * (cubo_size + cubo_spacing)); // Posição mais centralizada no bloco de terra
-    world.add(box(tree_base + vec3(-0.1, 0, -0.1), tree_base + vec3(0.1, 1.2, 0.1), wood)); // Tronco da árvore, agora centralizado
-    world.add(box(tree_base + vec3(-0.4, 1.2, -0.4), tree_base + vec3(0.4, 1.6, 0.4), leaves));  // Folhas inferior
-    world.add(box(tree_base + vec3(-0.3, 1.6, -0.3), tree_base + vec3(0.3, 1.9, 0.3), leaves));  // Folhas intermediária
-    world.add(box(tree_base + vec3(-0.2, 1.9, -0.2), tree_base + vec3(0.2, 2.1, 0.2), leaves));  // Folhas superior
+    world.add(make_shared<aabb_box>(tree_base + vec3(-0.1, 0, -0.1), tree_base + vec3(0.1, 1.2, 0.1), wood)); // Tronco da árvore, agora centralizado
+    world.add(make_shared<aabb_box>(tree_base + vec3(-0.4, 1.2, -0.4), tree_base + vec3(0.4, 1.6, 0.4), leaves));  // Folhas inferior
+    world.add(make_shared<aabb_box>(tree_base + vec3(-0.3, 1.6, -0.3), tree_base + vec3(0.3, 1.9, 0.3), leaves));  // Folhas intermediária
+    world.add(make_shared<aabb_box>(tree_base + vec3(-0.2, 1.9, -0.2), tree_base + vec3(0.2, 2.1, 0.2), leaves));  // Folhas superior
 
     // Adicionar uma fonte de luz emissiva (simulação de luz)
-    auto light_material = make_shared<lambertian>(color(4, 4, 4)); // Luz mais brilhante
+    auto light_material = make_shared<diffuse_light>(color(4, 4, 4)); // Luz mais brilhante
     world.add(make_shared<sphere>(point3(5, 5, -5), 1.0, light_material)); // Luz vinda da direita
 
     // Configuração da câmera
@@ -316,6 +313,189 @@ void scene_with_different_cam() {
     cam.lookat = point3(1, 1, 1.5);  
     cam.vup = vec3(0, 1, 0);
     cam.defocus_angle = 0;
+    cam.output_file = "final_scene3.png"; // Grava a imagem diretamente em PNG
+    cam.sampling = sampler_method::sobol; // Amostras bem distribuídas: menos ruído por amostra
+
+    // Amostragem explícita das luzes combinada com a da BSDF (MIS): cada acerto não especular
+    // lança um raio de sombra até a esfera emissiva. As luzes são coletadas antes de a lista
+    // virar uma BVH.
+    cam.integrator = integrator_method::mis;
+    light_list lights(world);
+
+    // Organiza os objetos em uma BVH linear para acelerar a interseção dos raios
+    world = hittable_list(make_shared<linear_bvh>(world));
+
+    // Renderizar a cena
+    cam.render(world, lights);
+}
+
+// Função para configurar e renderizar um mundo de blocos gerado por ruído
+void scene_voxel_world() {
+    auto side_material = make_shared<lambertian>(make_shared<image_texture>("img/blocomine.jpg"));
+    auto top_material = make_shared<lambertian>(make_shared<image_texture>("img/grama.jpg"));
+    auto stone = make_shared<lambertian>(color(0.45, 0.45, 0.45));
+    auto wood = make_shared<lambertian>(color(0.5, 0.25, 0.1));
+    auto leaves = make_shared<lambertian>(color(0.1, 0.8, 0.1));
+
+    // Mundo de 256 x 128 x 256 blocos (Y é a altura), guardado como uma grade densa de IDs
+    const int size_x = 256, size_y = 128, size_z = 256;
+    auto blocks = make_shared<voxel_grid>(point3(-size_x/2, 0, -size_z/2), size_x, size_y, size_z);
+
+    auto dirt_id = blocks->add_block_type(side_material, top_material, side_material);
+    auto stone_id = blocks->add_block_type(stone);
+    auto wood_id = blocks->add_block_type(wood);
+    auto leaves_id = blocks->add_block_type(leaves);
+
+    // O relevo vem do ruído de Perlin: pedra embaixo e três camadas de terra por cima
+    perlin noise;
+    for (int z = 0; z < size_z; ++z) {
+        for (int x = 0; x < size_x; ++x) {
+            double n = noise.turb(point3(x * 0.02, 0, z * 0.02), 4);
+            int height = std::min(size_y - 12, 20 + int(40 * n));
+
+            for (int y = 0; y < height; ++y)
+                blocks->set(x, y, z, (y < height - 3) ? stone_id : dirt_id);
+
+            // Algumas árvores espalhadas sobre a grama
+            if (x % 16 == 7 && z % 16 == 7 && noise.noise(point3(x, 0.5, z)) > 0) {
+                for (int y = height; y < height + 5; ++y)
+                    blocks->set(x, y, z, wood_id);
+                for (int dz = -2; dz <= 2; ++dz)
+                    for (int dx = -2; dx <= 2; ++dx)
+                        for (int y = height + 4; y < height + 7; ++y)
+                            if (dx != 0 || dz != 0 || y > height + 4)
+                                blocks->set(x + dx, y, z + dz, leaves_id);
+            }
+        }
+    }
+
+    hittable_list world;
+    world.add(blocks);
+
+    // Configuração da câmera
+    camera cam;
+    cam.aspect_ratio = 16.0 / 9.0;
+    cam.image_width = 800;
+    cam.samples_per_pixel = 100;
+    cam.max_depth = 50;
+    cam.background = color(0.70, 0.80, 1.00);
+    cam.vfov = 40;
+    cam.lookfrom = point3(-110, 90, -110);
+    cam.lookat = point3(0, 30, 0);
+    cam.vup = vec3(0, 1, 0);
+    cam.defocus_angle = 0;
+    cam.output_file = "final_voxel_world.png"; // Grava a imagem diretamente em PNG
+    cam.sampling = sampler_method::sobol; // Amostras bem distribuídas: menos ruído por amostra
+
+    // Renderizar a cena
+    cam.render(world);
+}
+
+// Função para configurar e renderizar uma floresta de árvores instanciadas
+void scene_forest() {
+    auto wood = make_shared<lambertian>(color(0.5, 0.25, 0.1));
+    auto leaves = make_shared<lambertian>(color(0.1, 0.8, 0.1));
+    auto grass = make_shared<lambertian>(make_shared<image_texture>("img/grama.jpg"));
+
+    // A geometria da árvore é construída uma única vez (protótipo), com a base na origem
+    hittable_list tree;
+    tree.add(make_shared<aabb_box>(point3(-0.1, 0, -0.1), point3(0.1, 1.2, 0.1), wood));     // Tronco
+    tree.add(make_shared<aabb_box>(point3(-0.4, 1.2, -0.4), point3(0.4, 1.6, 0.4), leaves)); // Folhas inferior
+    tree.add(make_shared<aabb_box>(point3(-0.3, 1.6, -0.3), point3(0.3, 1.9, 0.3), leaves)); // Folhas intermediária
+    tree.add(make_shared<aabb_box>(point3(-0.2, 1.9, -0.2), point3(0.2, 2.1, 0.2), leaves)); // Folhas superior
+
+    // Cada árvore da floresta é só uma instância: o índice do protótipo e uma transformação
+    auto forest = make_shared<instance_bvh>();
+    int tree_id = forest->add_prototype(make_shared<linear_bvh>(tree));
+
+    const int tree_count = 100000;
+    const double forest_size = 400;
+    for (int i = 0; i < tree_count; ++i) {
+        auto position = vec3(random_double(-0.5, 0.5) * forest_size, 0, random_double(-0.5, 0.5) * forest_size);
+        auto placement = mat4::translation(position)
+                       * mat4::rotation_y(random_double(0, 360))
+                       * mat4::scaling(random_double(0.7, 1.3));
+        forest->add_instance(tree_id, placement);
+    }
+    forest->build();
+
+    hittable_list world;
+    world.add(forest);
+    world.add(make_shared<quad>(point3(-forest_size, 0, -forest_size), vec3(2 * forest_size, 0, 0), vec3(0, 0, 2 * forest_size), grass)); // Chão
+
+    // Configuração da câmera
+    camera cam;
+    cam.aspect_ratio = 16.0 / 9.0;
+    cam.image_width = 800;
+    cam.samples_per_pixel = 100;
+    cam.max_depth = 50;
+    cam.background = color(0.70, 0.80, 1.00);
+    cam.vfov = 40;
+    cam.lookfrom = point3(0, 12, 60);
+    cam.lookat = point3(0, 0, 0);
+    cam.vup = vec3(0, 1, 0);
+    cam.defocus_angle = 0;
+    cam.output_file = "final_forest.png"; // Grava a imagem diretamente em PNG
+    cam.sampling = sampler_method::sobol; // Amostras bem distribuídas: menos ruído por amostra
+
+    // Renderizar a cena
+    cam.render(world);
+}
+
+// Função para configurar e renderizar a cena clássica de muitas esferas (capa do primeiro livro)
+void scene_many_spheres() {
+    hittable_list world;
+
+    auto ground_material = make_shared<lambertian>(color(0.5, 0.5, 0.5));
+    world.add(make_shared<sphere>(point3(0, -1000, 0), 1000, ground_material)); // Chão
+
+    // Esferas pequenas espalhadas numa grade 22x22, com material sorteado
+    for (int a = -11; a < 11; a++) {
+        for (int b = -11; b < 11; b++) {
+            auto choose_mat = random_double();
+            point3 center(a + 0.9 * random_double(), 0.2, b + 0.9 * random_double());
+
+            if ((center - point3(4, 0.2, 0)).length() > 0.9) {
+                if (choose_mat < 0.8) {
+                    // Difusa, quicando durante o obturador (desfoque de movimento)
+                    auto albedo = color::random() * color::random();
+                    auto center2 = center + vec3(0, random_double(0, 0.5), 0);
+                    world.add(make_shared<sphere>(center, center2, 0.2, make_shared<lambertian>(albedo)));
+                } else if (choose_mat < 0.95) {
+                    // Metal
+                    auto albedo = color::random(0.5, 1);
+                    auto fuzz = random_double(0, 0.5);
+                    world.add(make_shared<sphere>(center, 0.2, make_shared<metal>(albedo, fuzz)));
+                } else {
+                    // Vidro
+                    world.add(make_shared<sphere>(center, 0.2, make_shared<dielectric>(1.5)));
+                }
+            }
+        }
+    }
+
+    world.add(make_shared<sphere>(point3(0, 1, 0), 1.0, make_shared<dielectric>(1.5)));
+    world.add(make_shared<sphere>(point3(-4, 1, 0), 1.0, make_shared<lambertian>(color(0.4, 0.2, 0.1))));
+    world.add(make_shared<sphere>(point3(4, 1, 0), 1.0, make_shared<metal>(color(0.7, 0.6, 0.5), 0.0)));
+
+    // As esferas comuns nas folhas da BVH linear são testadas de quatro em quatro (SIMD)
+    world = hittable_list(make_shared<linear_bvh>(world));
+
+    // Configuração da câmera
+    camera cam;
+    cam.aspect_ratio = 16.0 / 9.0;
+    cam.image_width = 800;
+    cam.samples_per_pixel = 100;
+    cam.max_depth = 50;
+    cam.background = color(0.70, 0.80, 1.00);
+    cam.vfov = 20;
+    cam.lookfrom = point3(13, 2, 3);
+    cam.lookat = point3(0, 0, 0);
+    cam.vup = vec3(0, 1, 0);
+    cam.defocus_angle = 0.6;
+    cam.focus_dist = 10.0;
+    cam.output_file = "final_many_spheres.png"; // Grava a imagem diretamente em PNG
+    cam.sampling = sampler_method::sobol; // Amostras bem distribuídas: menos ruído por amostra
 
     // Renderizar a cena
     cam.render(world);
@@ -326,6 +506,9 @@ int main() {
     // Por favor, rode separadamente cada uma das cenas para verificar o funcionamento adequado!
     // scene_with_textured_cubes();
     // scene_with_inverted_spheres();
+    // scene_voxel_world();
+    // scene_forest();
+    // scene_many_spheres();
     scene_with_different_cam();
            
     return 0;
@@ -7,6 +7,8 @@
 #include <limits>      // Fornece os limites numéricos dos tipos de dados.
 #include <memory>      // Biblioteca para gerenciamento de memória dinâmica (ex: smart pointers).
 
+#include "rng.h"       // Geradores aleatórios por thread (xoshiro256++ / PCG).
+
 
 // Usings para facilitar o uso de tipos da biblioteca padrão
 using std::make_shared;    // Facilita a criação de smart pointers (shared_ptr).
@@ -25,8 +27,8 @@ inline double degrees_to_radians(double degrees) {
 
 // Retorna um número aleatório entre [0, 1).
 inline double random_double() {
-    // Utiliza a função rand() para gerar um valor aleatório.
-    return std::rand() / (RAND_MAX + 1.0);
+    // Utiliza o gerador da thread atual, sem estado global compartilhado.
+    return uniform_double(thread_rng().next_u64());
 }
 
 // Retorna um número aleatório no intervalo [min, max).
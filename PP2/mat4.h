@@ -0,0 +1,142 @@
+#ifndef MAT4_H
+#define MAT4_H
+//==============================================================================================
+// To the extent possible under law, the author(s) have dedicated all copyright and related and
+// neighboring rights to this software to the public domain worldwide. This software is
+// distributed without any warranty.
+//
+// You should have received a copy (see file COPYING.txt) of the CC0 Public Domain Dedication
+// along with this software. If not, see <http://creativecommons.org/publicdomain/zero/1.0/>.
+//==============================================================================================
+
+
+class mat4 {
+  public:
+    // A 4x4 matrix for affine transforms of points and vectors in homogeneous coordinates.
+    // The bottom row is always (0, 0, 0, 1), so only the top three rows are ever applied.
+
+    double m[4][4];
+
+    mat4() : m{{1,0,0,0}, {0,1,0,0}, {0,0,1,0}, {0,0,0,1}} {}
+
+    static mat4 identity() { return mat4(); }
+
+    static mat4 translation(const vec3& offset) {
+        mat4 result;
+        for (int i = 0; i < 3; i++)
+            result.m[i][3] = offset[i];
+        return result;
+    }
+
+    static mat4 scaling(const vec3& factors) {
+        mat4 result;
+        for (int i = 0; i < 3; i++)
+            result.m[i][i] = factors[i];
+        return result;
+    }
+
+    static mat4 scaling(double factor) {
+        return scaling(vec3(factor, factor, factor));
+    }
+
+    static mat4 rotation(const vec3& axis, double angle) {
+        // Counterclockwise rotation by angle degrees about the given axis (Rodrigues' formula).
+        auto a = unit_vector(axis);
+        auto radians = degrees_to_radians(angle);
+        auto s = std::sin(radians);
+        auto c = std::cos(radians);
+        auto t = 1 - c;
+
+        mat4 result;
+        result.m[0][0] = t*a.x()*a.x() + c;
+        result.m[0][1] = t*a.x()*a.y() - s*a.z();
+        result.m[0][2] = t*a.x()*a.z() + s*a.y();
+        result.m[1][0] = t*a.x()*a.y() + s*a.z();
+        result.m[1][1] = t*a.y()*a.y() + c;
+        result.m[1][2] = t*a.y()*a.z() - s*a.x();
+        result.m[2][0] = t*a.x()*a.z() - s*a.y();
+        result.m[2][1] = t*a.y()*a.z() + s*a.x();
+        result.m[2][2] = t*a.z()*a.z() + c;
+        return result;
+    }
+
+    static mat4 rotation_x(double angle) { return rotation(vec3(1,0,0), angle); }
+    static mat4 rotation_y(double angle) { return rotation(vec3(0,1,0), angle); }
+    static mat4 rotation_z(double angle) { return rotation(vec3(0,0,1), angle); }
+
+    point3 transform_point(const point3& p) const {
+        return point3(
+            m[0][0]*p.x() + m[0][1]*p.y() + m[0][2]*p.z() + m[0][3],
+            m[1][0]*p.x() + m[1][1]*p.y() + m[1][2]*p.z() + m[1][3],
+            m[2][0]*p.x() + m[2][1]*p.y() + m[2][2]*p.z() + m[2][3]
+        );
+    }
+
+    vec3 transform_vector(const vec3& v) const {
+        return vec3(
+            m[0][0]*v.x() + m[0][1]*v.y() + m[0][2]*v.z(),
+            m[1][0]*v.x() + m[1][1]*v.y() + m[1][2]*v.z(),
+            m[2][0]*v.x() + m[2][1]*v.y() + m[2][2]*v.z()
+        );
+    }
+
+    vec3 transform_transposed(const vec3& v) const {
+        // Applies the transpose of the upper 3x3 part. Normals transform by the inverse
+        // transpose, so this maps an object space normal to world space when called on the
+        // world-to-object matrix.
+        return vec3(
+            m[0][0]*v.x() + m[1][0]*v.y() + m[2][0]*v.z(),
+            m[0][1]*v.x() + m[1][1]*v.y() + m[2][1]*v.z(),
+            m[0][2]*v.x() + m[1][2]*v.y() + m[2][2]*v.z()
+        );
+    }
+
+    double determinant() const {
+        // Determinant of the upper 3x3 part: the factor by which the matrix scales volumes.
+        return m[0][0] * (m[1][1]*m[2][2] - m[1][2]*m[2][1])
+             - m[0][1] * (m[1][0]*m[2][2] - m[1][2]*m[2][0])
+             + m[0][2] * (m[1][0]*m[2][1] - m[1][1]*m[2][0]);
+    }
+
+    mat4 inverse() const {
+        // Inverts the upper 3x3 part by cofactors, then the translation. A singular matrix
+        // (such as a zero scale) has no inverse, and yields all zeros in the 3x3 part.
+
+        mat4 result;
+        auto det = determinant();
+        auto inv_det = (det != 0) ? 1 / det : 0.0;
+
+        result.m[0][0] =  (m[1][1]*m[2][2] - m[1][2]*m[2][1]) * inv_det;
+        result.m[0][1] = -(m[0][1]*m[2][2] - m[0][2]*m[2][1]) * inv_det;
+        result.m[0][2] =  (m[0][1]*m[1][2] - m[0][2]*m[1][1]) * inv_det;
+        result.m[1][0] = -(m[1][0]*m[2][2] - m[1][2]*m[2][0]) * inv_det;
+        result.m[1][1] =  (m[0][0]*m[2][2] - m[0][2]*m[2][0]) * inv_det;
+        result.m[1][2] = -(m[0][0]*m[1][2] - m[0][2]*m[1][0]) * inv_det;
+        result.m[2][0] =  (m[1][0]*m[2][1] - m[1][1]*m[2][0]) * inv_det;
+        result.m[2][1] = -(m[0][0]*m[2][1] - m[0][1]*m[2][0]) * inv_det;
+        result.m[2][2] =  (m[0][0]*m[1][1] - m[0][1]*m[1][0]) * inv_det;
+
+        auto offset = result.transform_vector(vec3(m[0][3], m[1][3], m[2][3]));
+        for (int i = 0; i < 3; i++)
+            result.m[i][3] = -offset[i];
+
+        return result;
+    }
+};
+
+
+inline mat4 operator*(const mat4& a, const mat4& b) {
+    // The product applies b first, then a.
+    mat4 result;
+    for (int i = 0; i < 4; i++) {
+        for (int j = 0; j < 4; j++) {
+            result.m[i][j] = 0;
+            for (int k = 0; k < 4; k++)
+                result.m[i][j] += a.m[i][k] * b.m[k][j];
+        }
+    }
+    return result;
+}
+
+
+#endif
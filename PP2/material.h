@@ -15,6 +15,16 @@
 #include "texture.h"
 
 
+class scatter_record {
+  public:
+    // The outcome of sampling a material's scattering at a hit.
+    ray    scattered;    // The continuation of the path
+    color  attenuation;  // Path throughput factor: eval() over pdf for the sampled direction
+    double pdf;          // Density of the sampled direction per unit solid angle
+    bool   is_specular;  // Direction from a mirror or refraction law; then pdf is not used
+};
+
+
 class material {
   public:
     virtual ~material() = default;
@@ -23,11 +33,29 @@ class material {
         return color(0,0,0);
     }
 
-    virtual bool scatter(
-        const ray& r_in, const hit_record& rec, color& attenuation, ray& scattered
-    ) const {
+    // Samples a direction for the path to continue in. Returns false if the light is absorbed.
+    virtual bool scatter(const ray& r_in, const hit_record& rec, scatter_record& srec) const {
         return false;
     }
+
+    // True for materials that give off light; shapes made of them can be sampled as lights.
+    virtual bool is_emissive() const { return false; }
+
+    // Materials that only scatter along a mirror or refraction direction return true here. The
+    // others implement eval() and pdf() for any unit vector direction, which lets a renderer
+    // pick directions itself (toward a light, say) and weigh them correctly:
+    //   - eval() is the fraction of the radiance arriving from direction that leaves back
+    //     along r_in, i.e. the BRDF (or phase function) times the cosine factor.
+    //   - pdf() is the density with which scatter() picks direction, per unit solid angle.
+    virtual bool is_specular() const { return true; }
+
+    virtual color eval(const ray& r_in, const hit_record& rec, const vec3& direction) const {
+        return color(0,0,0);
+    }
+
+    virtual double pdf(const ray& r_in, const hit_record& rec, const vec3& direction) const {
+        return 0;
+    }
 };
 
 
@@ -36,19 +64,33 @@ class lambertian : public material {
     lambertian(const color& albedo) : tex(make_shared<solid_color>(albedo)) {}
     lambertian(shared_ptr<texture> tex) : tex(tex) {}
 
-    bool scatter(const ray& r_in, const hit_record& rec, color& attenuation, ray& scattered)
-    const override {
+    bool scatter(const ray& r_in, const hit_record& rec, scatter_record& srec) const override {
+        // A random point on the unit sphere tangent to the surface at the hit point gives a
+        // cosine-weighted direction, which the BRDF's cosine factor cancels out exactly.
         auto scatter_direction = rec.normal + random_unit_vector();
 
         // Catch degenerate scatter direction
         if (scatter_direction.near_zero())
             scatter_direction = rec.normal;
 
-        scattered = ray(rec.p, scatter_direction, r_in.time());
-        attenuation = tex->value(rec.u, rec.v, rec.p);
+        srec.scattered = ray(rec.p, scatter_direction, r_in.time());
+        srec.attenuation = tex->value(rec.u, rec.v, rec.p);
+        srec.pdf = pdf(r_in, rec, unit_vector(scatter_direction));
+        srec.is_specular = false;
         return true;
     }
 
+    bool is_specular() const override { return false; }
+
+    color eval(const ray& r_in, const hit_record& rec, const vec3& direction) const override {
+        auto cosine = dot(rec.normal, direction);
+        return cosine > 0 ? tex->value(rec.u, rec.v, rec.p) * (cosine / pi) : color(0,0,0);
+    }
+
+    double pdf(const ray& r_in, const hit_record& rec, const vec3& direction) const override {
+        return std::fmax(0, dot(rec.normal, direction)) / pi;
+    }
+
   private:
     shared_ptr<texture> tex;
 };
@@ -58,13 +100,39 @@ class metal : public material {
   public:
     metal(const color& albedo, double fuzz) : albedo(albedo), fuzz(fuzz < 1 ? fuzz : 1) {}
 
-    bool scatter(const ray& r_in, const hit_record& rec, color& attenuation, ray& scattered)
-    const override {
+    bool scatter(const ray& r_in, const hit_record& rec, scatter_record& srec) const override {
         vec3 reflected = reflect(r_in.direction(), rec.normal);
         reflected = unit_vector(reflected) + (fuzz * random_unit_vector());
-        scattered = ray(rec.p, reflected, r_in.time());
-        attenuation = albedo;
-        return (dot(scattered.direction(), rec.normal) > 0);
+        srec.scattered = ray(rec.p, reflected, r_in.time());
+        srec.attenuation = albedo;
+        srec.is_specular = (fuzz == 0);
+        srec.pdf = srec.is_specular ? 0 : pdf(r_in, rec, unit_vector(reflected));
+        return (dot(srec.scattered.direction(), rec.normal) > 0);
+    }
+
+    bool is_specular() const override { return fuzz == 0; }
+
+    color eval(const ray& r_in, const hit_record& rec, const vec3& direction) const override {
+        // Directions below the surface are absorbed, so above it the reflected fraction is the
+        // albedo spread over the sampling density.
+        return albedo * pdf(r_in, rec, direction);
+    }
+
+    double pdf(const ray& r_in, const hit_record& rec, const vec3& direction) const override {
+        // scatter() offsets the unit mirror direction R by a uniform random point on a sphere
+        // of radius fuzz. A direction at angle alpha from R meets that sphere at the distances
+        // cos(alpha) +- h, with h = sqrt(fuzz^2 - sin^2(alpha)); summing the area-to-solid
+        // angle factor of both points gives the density below.
+        if (fuzz == 0 || dot(rec.normal, direction) <= 0)
+            return 0;
+
+        auto mirror = unit_vector(reflect(r_in.direction(), rec.normal));
+        auto cos_alpha = dot(mirror, direction);
+        auto h_squared = fuzz*fuzz - (1 - cos_alpha*cos_alpha);
+        if (cos_alpha <= 0 || h_squared <= 0)
+            return 0;
+
+        return (cos_alpha*cos_alpha + h_squared) / (2*pi * fuzz * std::sqrt(h_squared));
     }
 
   private:
@@ -77,9 +145,12 @@ class dielectric : public material {
   public:
     dielectric(double refraction_index) : refraction_index(refraction_index) {}
 
-    bool scatter(const ray& r_in, const hit_record& rec, color& attenuation, ray& scattered)
-    const override {
-        attenuation = color(1.0, 1.0, 1.0);
+    bool scatter(const ray& r_in, const hit_record& rec, scatter_record& srec) const override {
+        // Reflection and refraction are both delta distributions; the Fresnel choice between
+        // them is made here, so the attenuation stays one.
+        srec.attenuation = color(1.0, 1.0, 1.0);
+        srec.pdf = 0;
+        srec.is_specular = true;
         double ri = rec.front_face ? (1.0/refraction_index) : refraction_index;
 
         vec3 unit_direction = unit_vector(r_in.direction());
@@ -94,7 +165,7 @@ class dielectric : public material {
         else
             direction = refract(unit_direction, rec.normal, ri);
 
-        scattered = ray(rec.p, direction, r_in.time());
+        srec.scattered = ray(rec.p, direction, r_in.time());
         return true;
     }
 
@@ -121,6 +192,8 @@ class diffuse_light : public material {
         return tex->value(u, v, p);
     }
 
+    bool is_emissive() const override { return true; }
+
   private:
     shared_ptr<texture> tex;
 };
@@ -131,13 +204,24 @@ class isotropic : public material {
     isotropic(const color& albedo) : tex(make_shared<solid_color>(albedo)) {}
     isotropic(shared_ptr<texture> tex) : tex(tex) {}
 
-    bool scatter(const ray& r_in, const hit_record& rec, color& attenuation, ray& scattered)
-    const override {
-        scattered = ray(rec.p, random_unit_vector(), r_in.time());
-        attenuation = tex->value(rec.u, rec.v, rec.p);
+    bool scatter(const ray& r_in, const hit_record& rec, scatter_record& srec) const override {
+        srec.scattered = ray(rec.p, random_unit_vector(), r_in.time());
+        srec.attenuation = tex->value(rec.u, rec.v, rec.p);
+        srec.pdf = 1 / (4*pi);
+        srec.is_specular = false;
         return true;
     }
 
+    bool is_specular() const override { return false; }
+
+    color eval(const ray& r_in, const hit_record& rec, const vec3& direction) const override {
+        return tex->value(rec.u, rec.v, rec.p) / (4*pi);
+    }
+
+    double pdf(const ray& r_in, const hit_record& rec, const vec3& direction) const override {
+        return 1 / (4*pi);
+    }
+
   private:
     shared_ptr<texture> tex;
 };
@@ -0,0 +1,234 @@
+#ifndef MOTION_BVH_H
+#define MOTION_BVH_H
+//==============================================================================================
+// To the extent possible under law, the author(s) have dedicated all copyright and related and
+// neighboring rights to this software to the public domain worldwide. This software is
+// distributed without any warranty.
+//
+// You should have received a copy (see file COPYING.txt) of the CC0 Public Domain Dedication
+// along with this software. If not, see <http://creativecommons.org/publicdomain/zero/1.0/>.
+//==============================================================================================
+
+#include "hittable.h"
+#include "hittable_list.h"
+#include "linear_bvh.h"
+
+#include <chrono>
+#include <vector>
+
+
+class motion_bvh : public hittable {
+  public:
+    // A flattened BVH for scenes with moving objects. Every node keeps its bounds at the start
+    // and at the end of a time span, and a ray is tested against the box interpolated at its
+    // own time. Since each object's box moves linearly with time, the interpolated box always
+    // contains the node's objects at that time.
+    //
+    // Objects that are close together at one time may drift apart at another, which inflates
+    // the interpolated boxes away from the time the tree was built for. To keep them tight the
+    // shutter interval is cut into time_segments equal spans, each with a tree built for its
+    // own middle time. A ray only traverses the tree of the span containing its time. More
+    // spans also mean more trees competing for the cache, so by default (time_segments = 0) the
+    // count is picked from how far the objects move relative to their size.
+
+    motion_bvh(
+        const hittable_list& list, const bvh_build_options& options = linear_bvh::sah_options(),
+        int max_leaf_size = 4, int time_segments = 0
+    ) {
+        auto start_time = std::chrono::steady_clock::now();
+
+        if (time_segments <= 0)
+            time_segments = automatic_time_segments(list);
+        segments.resize(time_segments);
+
+        double cost = 0;
+        for (int k = 0; k < time_segments; k++) {
+            auto& segment = segments[k];
+            segment.start = double(k) / time_segments;
+            segment.end = double(k + 1) / time_segments;
+
+            // Build the tree over the boxes at the middle of the span, then refit it at both
+            // ends of the span.
+            std::vector<aabb> boxes;
+            boxes.reserve(list.objects.size());
+            for (const auto& object : list.objects)
+                boxes.push_back(object->bounding_box_at(0.5 * (segment.start + segment.end)));
+
+            std::vector<int> order;
+            cost += build_linear_bvh(boxes, options, max_leaf_size, segment.nodes, order)
+                  / time_segments;
+
+            // Store the primitives in leaf order, so that a leaf references a contiguous range.
+            segment.primitives.reserve(order.size());
+            for (auto index : order)
+                segment.primitives.push_back(list.objects[index]);
+
+            refit(segment);
+        }
+
+        std::chrono::duration<double, std::milli> elapsed =
+            std::chrono::steady_clock::now() - start_time;
+
+        std::clog << "Motion BVH (" << (options.split == bvh_split_method::sah ? "SAH" : "median")
+                  << "): " << list.objects.size() << " objects, " << time_segments
+                  << " time segments of " << segments[0].nodes.size() << " nodes, SAH cost "
+                  << cost << ", built in " << elapsed.count() << " ms\n";
+    }
+
+    bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
+        auto time = r.time();
+        auto k = std::min(std::max(int(time * segments.size()), 0), int(segments.size()) - 1);
+        const auto& segment = segments[k];
+        auto s = (time - segment.start) / (segment.end - segment.start);
+
+        return traverse_linear_bvh(segment.nodes, r, ray_t,
+            [&](int index, const interval& t) { return box_hit(segment, index, s, r, t); },
+            [&](int first, int count, interval& t) {
+                hit_record temp_rec;
+                bool hit_anything = false;
+                for (int i = first; i < first + count; i++) {
+                    if (segment.primitives[i]->hit(r, t, temp_rec)) {
+                        hit_anything = true;
+                        t.max = temp_rec.t;
+                        rec = temp_rec;
+                    }
+                }
+                return hit_anything;
+            });
+    }
+
+    bool occluded(const ray& r, interval ray_t) const override {
+        auto time = r.time();
+        auto k = std::min(std::max(int(time * segments.size()), 0), int(segments.size()) - 1);
+        const auto& segment = segments[k];
+        auto s = (time - segment.start) / (segment.end - segment.start);
+
+        return occluded_linear_bvh(segment.nodes, r, ray_t,
+            [&](int index, const interval& t) { return box_hit(segment, index, s, r, t); },
+            [&](int first, int count, const interval& t) {
+                for (int i = first; i < first + count; i++) {
+                    if (segment.primitives[i]->occluded(r, t))
+                        return true;
+                }
+                return false;
+            });
+    }
+
+    aabb bounding_box() const override {
+        auto box = aabb::empty;
+        for (const auto& segment : segments) {
+            if (!segment.nodes.empty())
+                box = aabb(box, aabb(segment.nodes[0].bbox, segment.end_bounds[0]));
+        }
+        return box;
+    }
+
+    aabb bounding_box_at(double time) const override {
+        auto k = std::min(std::max(int(time * segments.size()), 0), int(segments.size()) - 1);
+        const auto& segment = segments[k];
+        if (segment.nodes.empty())
+            return aabb::empty;
+        return box_at(segment, 0, (time - segment.start) / (segment.end - segment.start));
+    }
+
+  private:
+    class time_segment {
+      public:
+        double start, end;
+        std::vector<shared_ptr<hittable>> primitives;
+        std::vector<linear_bvh_node> nodes;  // Node bounds are the bounds at the span start
+        std::vector<aabb> end_bounds;        // Node bounds at the span end
+    };
+
+    std::vector<time_segment> segments;
+
+    static int automatic_time_segments(const hittable_list& list) {
+        // One span for every doubling of the average distance an object travels over the
+        // shutter interval, measured in object sizes, up to eight spans.
+
+        double travel = 0, size = 0;
+        for (const auto& object : list.objects) {
+            auto b0 = object->bounding_box_at(0);
+            auto b1 = object->bounding_box_at(1);
+            auto center0 = point3(b0.x.min + b0.x.max, b0.y.min + b0.y.max, b0.z.min + b0.z.max);
+            auto center1 = point3(b1.x.min + b1.x.max, b1.y.min + b1.y.max, b1.z.min + b1.z.max);
+            travel += (center1 - center0).length() / 2;
+            size += vec3(b0.x.size(), b0.y.size(), b0.z.size()).length();
+        }
+
+        int segments = 1;
+        while (segments < 8 && travel >= 2 * segments * size)
+            segments *= 2;
+        return segments;
+    }
+
+    static void refit(time_segment& segment) {
+        // Children always follow their parent in the node array, so a reverse sweep visits
+        // every child before its parent.
+
+        auto& nodes = segment.nodes;
+        auto& end_bounds = segment.end_bounds;
+        end_bounds.assign(nodes.size(), aabb::empty);
+
+        for (size_t i = nodes.size(); i-- > 0; ) {
+            auto& node = nodes[i];
+            if (node.count > 0) {
+                node.bbox = aabb::empty;
+                for (int k = node.offset; k < node.offset + node.count; k++) {
+                    const auto& object = segment.primitives[k];
+                    node.bbox = aabb(node.bbox, object->bounding_box_at(segment.start));
+                    end_bounds[i] = aabb(end_bounds[i], object->bounding_box_at(segment.end));
+                }
+            } else {
+                node.bbox = aabb(nodes[i+1].bbox, nodes[node.offset].bbox);
+                end_bounds[i] = aabb(end_bounds[i+1], end_bounds[node.offset]);
+            }
+        }
+    }
+
+    static bool box_hit(
+        const time_segment& segment, int index, double s, const ray& r, interval ray_t
+    ) {
+        // The slab test of aabb::hit(), against the node's bounds interpolated to fraction s
+        // of the way through the segment's time span.
+
+        const auto& b0 = segment.nodes[index].bbox;
+        const auto& b1 = segment.end_bounds[index];
+        const point3& ray_orig = r.origin();
+        const vec3&   ray_inv  = r.inverse_direction();
+
+        for (int axis = 0; axis < 3; axis++) {
+            const interval& i0 = b0.axis_interval(axis);
+            const interval& i1 = b1.axis_interval(axis);
+            auto lo = i0.min + s*(i1.min - i0.min);
+            auto hi = i0.max + s*(i1.max - i0.max);
+            bool neg = r.is_negative(axis);
+
+            auto t_near = ((neg ? hi : lo) - ray_orig[axis]) * ray_inv[axis];
+            auto t_far  = ((neg ? lo : hi) - ray_orig[axis]) * ray_inv[axis];
+
+            ray_t.min = t_near > ray_t.min ? t_near : ray_t.min;
+            ray_t.max = t_far < ray_t.max ? t_far : ray_t.max;
+        }
+        return ray_t.min < ray_t.max;
+    }
+
+    static aabb box_at(const time_segment& segment, int index, double s) {
+        // Bounds of a node at fraction s of the way through the segment's time span.
+        const auto& b0 = segment.nodes[index].bbox;
+        const auto& b1 = segment.end_bounds[index];
+
+        auto lerp = [s](const interval& i0, const interval& i1) {
+            return interval(i0.min + s*(i1.min - i0.min), i0.max + s*(i1.max - i0.max));
+        };
+
+        aabb box;
+        box.x = lerp(b0.x, b1.x);
+        box.y = lerp(b0.y, b1.y);
+        box.z = lerp(b0.z, b1.z);
+        return box;
+    }
+};
+
+
+#endif
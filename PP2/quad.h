@@ -22,6 +22,7 @@ class quad : public hittable {
         normal = unit_vector(n);
         D = dot(normal, Q);
         w = n / dot(n,n);
+        area = n.length();
 
         set_bounding_box();
     }
@@ -60,11 +61,54 @@ class quad : public hittable {
         rec.t = t;
         rec.p = intersection;
         rec.mat = mat;
+        rec.object = this;
         rec.set_face_normal(r, normal);
 
         return true;
     }
 
+    bool occluded(const ray& r, interval ray_t) const override {
+        auto denom = dot(normal, r.direction());
+        if (std::fabs(denom) < 1e-8)
+            return false;
+
+        auto t = (D - dot(normal, r.origin())) / denom;
+        if (!ray_t.contains(t))
+            return false;
+
+        // is_interior() only writes the texture coordinates, into a scratch record here.
+        vec3 planar_hitpt_vector = r.at(t) - Q;
+        hit_record scratch;
+        return is_interior(dot(w, cross(planar_hitpt_vector, v)),
+                           dot(w, cross(u, planar_hitpt_vector)), scratch);
+    }
+
+    shared_ptr<material> light_material() const override { return mat; }
+
+    double pdf_value(const point3& origin, const vec3& direction, double time) const override {
+        // random() picks points uniformly over the area; convert that density to solid angle.
+        hit_record rec;
+        if (!this->hit(ray(origin, direction, time), interval(0.001, infinity), rec))
+            return 0;
+
+        auto distance_squared = rec.t * rec.t * direction.length_squared();
+        auto cosine = std::fabs(dot(direction, rec.normal) / direction.length());
+
+        return distance_squared / (cosine * area);
+    }
+
+    vec3 random(const point3& origin, double time) const override {
+        auto p = Q + (random_double() * u) + (random_double() * v);
+        return p - origin;
+    }
+
+    double surface_area() const override { return area; }
+
+    double normal_cone(vec3& axis) const override {
+        axis = normal;
+        return 1.0;
+    }
+
     virtual bool is_interior(double a, double b, hit_record& rec) const {
         interval unit_interval = interval(0, 1);
         // Given the hit point in plane coordinates, return false if it is outside the
@@ -79,6 +123,8 @@ class quad : public hittable {
     }
 
   private:
+    friend class quad_packet;  // Copies the plane setup into its SIMD layout
+
     point3 Q;
     vec3 u, v;
     vec3 w;
@@ -86,6 +132,7 @@ class quad : public hittable {
     aabb bbox;
     vec3 normal;
     double D;
+    double area;
 };
 
 
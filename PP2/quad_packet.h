@@ -0,0 +1,249 @@
+#ifndef QUAD_PACKET_H
+#define QUAD_PACKET_H
+//==============================================================================================
+// To the extent possible under law, the author(s) have dedicated all copyright and related and
+// neighboring rights to this software to the public domain worldwide. This software is
+// distributed without any warranty.
+//
+// You should have received a copy (see file COPYING.txt) of the CC0 Public Domain Dedication
+// along with this software. If not, see <http://creativecommons.org/publicdomain/zero/1.0/>.
+//==============================================================================================
+
+#include "quad.h"
+#include "simd.h"
+
+#include <typeinfo>
+
+
+class quad_packet {
+  public:
+    // Up to four quads stored as a structure of arrays, so that one ray is tested against all
+    // of them at once with SIMD instructions (AVX2 or SSE2, picked at run time) and only the
+    // closest hit fills in a hit record.
+    //
+    // The plane coordinates of the hit point are computed as dot products with the
+    // precomputed vectors cross(v,w) and cross(w,u), which equal the quad's
+    // dot(w, cross(p,v)) and dot(w, cross(u,p)) without any cross products per ray.
+
+    static const int width = 4;
+
+    static bool packable(const hittable& object) {
+        // Only plain quads: subclasses may override is_interior() with another shape.
+        return typeid(object) == typeid(quad);
+    }
+
+    quad_packet() {
+        // Empty lanes have a zero normal, which every ray treats as parallel, so they never hit.
+        for (int i = 0; i < width; i++) {
+            nx[i] = ny[i] = nz[i] = d[i] = 0;
+            qx[i] = qy[i] = qz[i] = 0;
+            ax[i] = ay[i] = az[i] = 0;
+            bx[i] = by[i] = bz[i] = 0;
+            quads[i] = nullptr;
+        }
+    }
+
+    int size() const { return count; }
+
+    void add(const quad& q) {
+        if (count >= width)
+            return;
+
+        auto a = cross(q.v, q.w);
+        auto b = cross(q.w, q.u);
+
+        nx[count] = q.normal.x(); ny[count] = q.normal.y(); nz[count] = q.normal.z();
+        d[count]  = q.D;
+        qx[count] = q.Q.x();      qy[count] = q.Q.y();      qz[count] = q.Q.z();
+        ax[count] = a.x();        ay[count] = a.y();        az[count] = a.z();
+        bx[count] = b.x();        by[count] = b.y();        bz[count] = b.z();
+        quads[count] = &q;
+        count++;
+    }
+
+    bool hit(const ray& r, const interval& ray_t, hit_record& rec) const {
+        // Misses get an infinite distance in the lane outputs.
+        alignas(32) double t[width], alpha[width], beta[width];
+        intersect(r, ray_t, t, alpha, beta);
+
+        int lane = -1;
+        double closest = infinity;
+        for (int i = 0; i < width; i++) {
+            if (t[i] < closest) {
+                closest = t[i];
+                lane = i;
+            }
+        }
+
+        if (lane < 0)
+            return false;
+
+        const auto& q = *quads[lane];
+        rec.t = closest;
+        rec.p = r.at(closest);
+        rec.mat = q.mat;
+        rec.object = &q;
+        rec.set_face_normal(r, q.normal);
+        rec.u = alpha[lane];
+        rec.v = beta[lane];
+
+        return true;
+    }
+
+    bool occluded(const ray& r, const interval& ray_t) const {
+        alignas(32) double t[width], alpha[width], beta[width];
+        intersect(r, ray_t, t, alpha, beta);
+        for (int i = 0; i < width; i++) {
+            if (t[i] < infinity)
+                return true;
+        }
+        return false;
+    }
+
+  private:
+    alignas(32) double nx[width], ny[width], nz[width], d[width];  // Plane normal and offset
+    alignas(32) double qx[width], qy[width], qz[width];            // Corner Q
+    alignas(32) double ax[width], ay[width], az[width];            // cross(v,w)
+    alignas(32) double bx[width], by[width], bz[width];            // cross(w,u)
+    const quad* quads[width];
+    int count = 0;
+
+    void intersect(
+        const ray& r, const interval& ray_t, double* t, double* alpha, double* beta
+    ) const {
+        switch (active_simd_level()) {
+          #if RTW_SIMD_AVX2
+            case simd_level::avx2: intersect_avx2(r, ray_t, t, alpha, beta); break;
+          #endif
+          #if RTW_SIMD_X86
+            case simd_level::sse2: intersect_sse2(r, ray_t, t, alpha, beta); break;
+          #endif
+            default:               intersect_scalar(r, ray_t, t, alpha, beta); break;
+        }
+    }
+
+    void intersect_scalar(
+        const ray& r, const interval& ray_t, double* t, double* alpha, double* beta
+    ) const {
+        const auto& o = r.origin();
+        const auto& dir = r.direction();
+
+        for (int i = 0; i < width; i++) {
+            auto denom = nx[i]*dir.x() + ny[i]*dir.y() + nz[i]*dir.z();
+            auto dist = (d[i] - (nx[i]*o.x() + ny[i]*o.y() + nz[i]*o.z())) / denom;
+
+            auto hx = o.x() + dist*dir.x() - qx[i];
+            auto hy = o.y() + dist*dir.y() - qy[i];
+            auto hz = o.z() + dist*dir.z() - qz[i];
+            alpha[i] = hx*ax[i] + hy*ay[i] + hz*az[i];
+            beta[i]  = hx*bx[i] + hy*by[i] + hz*bz[i];
+
+            bool inside = std::fabs(denom) >= 1e-8 && ray_t.contains(dist)
+                       && alpha[i] >= 0 && alpha[i] <= 1 && beta[i] >= 0 && beta[i] <= 1;
+            t[i] = inside ? dist : infinity;
+        }
+    }
+
+  #if RTW_SIMD_X86
+    void intersect_sse2(
+        const ray& r, const interval& ray_t, double* t, double* alpha, double* beta
+    ) const {
+        const auto ox = _mm_set1_pd(r.origin().x());
+        const auto oy = _mm_set1_pd(r.origin().y());
+        const auto oz = _mm_set1_pd(r.origin().z());
+        const auto dx = _mm_set1_pd(r.direction().x());
+        const auto dy = _mm_set1_pd(r.direction().y());
+        const auto dz = _mm_set1_pd(r.direction().z());
+        const auto t_min = _mm_set1_pd(ray_t.min);
+        const auto t_max = _mm_set1_pd(ray_t.max);
+        const auto zero = _mm_setzero_pd();
+        const auto one = _mm_set1_pd(1.0);
+        const auto epsilon = _mm_set1_pd(1e-8);
+        const auto sign_bit = _mm_set1_pd(-0.0);
+        const auto inf = _mm_set1_pd(infinity);
+
+        for (int i = 0; i < width; i += 2) {
+            auto n_x = _mm_load_pd(nx + i), n_y = _mm_load_pd(ny + i), n_z = _mm_load_pd(nz + i);
+
+            auto denom = _mm_add_pd(_mm_add_pd(_mm_mul_pd(n_x, dx), _mm_mul_pd(n_y, dy)),
+                                    _mm_mul_pd(n_z, dz));
+            auto n_dot_o = _mm_add_pd(_mm_add_pd(_mm_mul_pd(n_x, ox), _mm_mul_pd(n_y, oy)),
+                                      _mm_mul_pd(n_z, oz));
+            auto dist = _mm_div_pd(_mm_sub_pd(_mm_load_pd(d + i), n_dot_o), denom);
+
+            auto hx = _mm_sub_pd(_mm_add_pd(ox, _mm_mul_pd(dist, dx)), _mm_load_pd(qx + i));
+            auto hy = _mm_sub_pd(_mm_add_pd(oy, _mm_mul_pd(dist, dy)), _mm_load_pd(qy + i));
+            auto hz = _mm_sub_pd(_mm_add_pd(oz, _mm_mul_pd(dist, dz)), _mm_load_pd(qz + i));
+
+            auto a = _mm_add_pd(_mm_add_pd(_mm_mul_pd(hx, _mm_load_pd(ax + i)),
+                                           _mm_mul_pd(hy, _mm_load_pd(ay + i))),
+                                _mm_mul_pd(hz, _mm_load_pd(az + i)));
+            auto b = _mm_add_pd(_mm_add_pd(_mm_mul_pd(hx, _mm_load_pd(bx + i)),
+                                           _mm_mul_pd(hy, _mm_load_pd(by + i))),
+                                _mm_mul_pd(hz, _mm_load_pd(bz + i)));
+
+            auto mask = _mm_cmpge_pd(_mm_andnot_pd(sign_bit, denom), epsilon);
+            mask = _mm_and_pd(mask, _mm_and_pd(_mm_cmpge_pd(dist, t_min),
+                                               _mm_cmple_pd(dist, t_max)));
+            mask = _mm_and_pd(mask, _mm_and_pd(_mm_cmpge_pd(a, zero), _mm_cmple_pd(a, one)));
+            mask = _mm_and_pd(mask, _mm_and_pd(_mm_cmpge_pd(b, zero), _mm_cmple_pd(b, one)));
+
+            _mm_store_pd(t + i, _mm_or_pd(_mm_and_pd(mask, dist), _mm_andnot_pd(mask, inf)));
+            _mm_store_pd(alpha + i, a);
+            _mm_store_pd(beta + i, b);
+        }
+    }
+  #endif
+
+  #if RTW_SIMD_AVX2
+    RTW_TARGET_AVX2
+    void intersect_avx2(
+        const ray& r, const interval& ray_t, double* t, double* alpha, double* beta
+    ) const {
+        const auto ox = _mm256_set1_pd(r.origin().x());
+        const auto oy = _mm256_set1_pd(r.origin().y());
+        const auto oz = _mm256_set1_pd(r.origin().z());
+        const auto dx = _mm256_set1_pd(r.direction().x());
+        const auto dy = _mm256_set1_pd(r.direction().y());
+        const auto dz = _mm256_set1_pd(r.direction().z());
+
+        auto n_x = _mm256_load_pd(nx), n_y = _mm256_load_pd(ny), n_z = _mm256_load_pd(nz);
+
+        auto denom = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(n_x, dx), _mm256_mul_pd(n_y, dy)),
+                                   _mm256_mul_pd(n_z, dz));
+        auto n_dot_o = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(n_x, ox), _mm256_mul_pd(n_y, oy)),
+                                     _mm256_mul_pd(n_z, oz));
+        auto dist = _mm256_div_pd(_mm256_sub_pd(_mm256_load_pd(d), n_dot_o), denom);
+
+        auto hx = _mm256_sub_pd(_mm256_add_pd(ox, _mm256_mul_pd(dist, dx)), _mm256_load_pd(qx));
+        auto hy = _mm256_sub_pd(_mm256_add_pd(oy, _mm256_mul_pd(dist, dy)), _mm256_load_pd(qy));
+        auto hz = _mm256_sub_pd(_mm256_add_pd(oz, _mm256_mul_pd(dist, dz)), _mm256_load_pd(qz));
+
+        auto a = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(hx, _mm256_load_pd(ax)),
+                                             _mm256_mul_pd(hy, _mm256_load_pd(ay))),
+                               _mm256_mul_pd(hz, _mm256_load_pd(az)));
+        auto b = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(hx, _mm256_load_pd(bx)),
+                                             _mm256_mul_pd(hy, _mm256_load_pd(by))),
+                               _mm256_mul_pd(hz, _mm256_load_pd(bz)));
+
+        const auto zero = _mm256_setzero_pd();
+        const auto one = _mm256_set1_pd(1.0);
+        auto abs_denom = _mm256_andnot_pd(_mm256_set1_pd(-0.0), denom);
+
+        auto mask = _mm256_cmp_pd(abs_denom, _mm256_set1_pd(1e-8), _CMP_GE_OQ);
+        mask = _mm256_and_pd(mask, _mm256_cmp_pd(dist, _mm256_set1_pd(ray_t.min), _CMP_GE_OQ));
+        mask = _mm256_and_pd(mask, _mm256_cmp_pd(dist, _mm256_set1_pd(ray_t.max), _CMP_LE_OQ));
+        mask = _mm256_and_pd(mask, _mm256_cmp_pd(a, zero, _CMP_GE_OQ));
+        mask = _mm256_and_pd(mask, _mm256_cmp_pd(a, one, _CMP_LE_OQ));
+        mask = _mm256_and_pd(mask, _mm256_cmp_pd(b, zero, _CMP_GE_OQ));
+        mask = _mm256_and_pd(mask, _mm256_cmp_pd(b, one, _CMP_LE_OQ));
+
+        _mm256_store_pd(t, _mm256_blendv_pd(_mm256_set1_pd(infinity), dist, mask));
+        _mm256_store_pd(alpha, a);
+        _mm256_store_pd(beta, b);
+    }
+  #endif
+};
+
+
+#endif
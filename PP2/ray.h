@@ -19,13 +19,24 @@ class ray {
     ray() {}
 
     ray(const point3& origin, const vec3& direction, double time)
-      : orig(origin), dir(direction), tm(time) {}
+      : orig(origin), dir(direction), tm(time)
+    {
+        // Box tests divide by the direction at every node, so the reciprocal and the sign of
+        // each component are computed once here. A zero component gives an infinite inverse.
+        inv_dir = vec3(1 / dir.x(), 1 / dir.y(), 1 / dir.z());
+        for (int axis = 0; axis < 3; axis++)
+            neg[axis] = std::signbit(dir[axis]);
+    }
 
     ray(const point3& origin, const vec3& direction)
       : ray(origin, direction, 0) {}
 
     const point3& origin() const  { return orig; }
     const vec3& direction() const { return dir; }
+    const vec3& inverse_direction() const { return inv_dir; }
+
+    // True if the direction points toward negative coordinates along the axis.
+    bool is_negative(int axis) const { return neg[axis]; }
 
     double time() const { return tm; }
 
@@ -37,6 +48,8 @@ class ray {
     point3 orig;
     vec3 dir;
     double tm;
+    vec3 inv_dir;
+    bool neg[3];
 };
 
 
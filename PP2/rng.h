@@ -0,0 +1,205 @@
+#ifndef RNG_H
+#define RNG_H
+//==============================================================================================
+// To the extent possible under law, the author(s) have dedicated all copyright and related and
+// neighboring rights to this software to the public domain worldwide. This software is
+// distributed without any warranty.
+//
+// You should have received a copy (see file COPYING.txt) of the CC0 Public Domain Dedication
+// along with this software. If not, see <http://creativecommons.org/publicdomain/zero/1.0/>.
+//==============================================================================================
+
+#include <cstddef>
+#include <cstdint>
+
+
+inline uint64_t splitmix64(uint64_t& state) {
+    // Advances the state and returns a well-mixed 64-bit value. Used to expand seeds.
+    uint64_t z = (state += 0x9e3779b97f4a7c15ull);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+}
+
+
+class xoshiro256pp {
+  public:
+    // xoshiro256++ by David Blackman and Sebastiano Vigna: 256 bits of state, very fast, and
+    // statistically strong enough for Monte Carlo integration.
+
+    xoshiro256pp() { seed(0); }
+
+    void seed(uint64_t value) {
+        for (auto& word : s)
+            word = splitmix64(value);
+    }
+
+    uint64_t next_u64() {
+        const uint64_t result = rotl(s[0] + s[3], 23) + s[0];
+        const uint64_t t = s[1] << 17;
+
+        s[2] ^= s[0];
+        s[3] ^= s[1];
+        s[1] ^= s[2];
+        s[0] ^= s[3];
+        s[2] ^= t;
+        s[3] = rotl(s[3], 45);
+
+        return result;
+    }
+
+  private:
+    uint64_t s[4];
+
+    static uint64_t rotl(uint64_t x, int k) {
+        return (x << k) | (x >> (64 - k));
+    }
+};
+
+
+class pcg32 {
+  public:
+    // PCG-XSH-RR by Melissa O'Neill: 64 bits of state and a 32-bit output, so two steps are
+    // combined per 64-bit draw.
+
+    pcg32() { seed(0); }
+
+    void seed(uint64_t value) {
+        state = 0;
+        inc = (splitmix64(value) << 1) | 1;
+        step();
+        state += splitmix64(value);
+        step();
+    }
+
+    uint64_t next_u64() {
+        uint64_t hi = step();
+        return (hi << 32) | step();
+    }
+
+  private:
+    uint64_t state;
+    uint64_t inc;
+
+    uint32_t step() {
+        uint64_t old = state;
+        state = old * 6364136223846793005ull + inc;
+        uint32_t xorshifted = uint32_t(((old >> 18) ^ old) >> 27);
+        uint32_t rot = uint32_t(old >> 59);
+        return (xorshifted >> rot) | (xorshifted << ((32 - rot) & 31));
+    }
+};
+
+
+// The generator behind random_double(). Define RTW_RNG_PCG before including this header to
+// switch engines; any class with seed(uint64_t) and next_u64() can be plugged in here.
+#ifdef RTW_RNG_PCG
+using rng_engine = pcg32;
+#else
+using rng_engine = xoshiro256pp;
+#endif
+
+
+inline rng_engine& thread_rng() {
+    // Each thread owns its own generator, so drawing numbers never contends on shared state.
+    thread_local rng_engine engine;
+    return engine;
+}
+
+inline void seed_thread_rng(uint64_t frame_seed, uint64_t pixel_index, uint64_t sample_index) {
+    // Reseeds the calling thread's generator from a (pixel, sample) pair. The camera does this
+    // before tracing each sample, so the random stream of a sample depends only on where it is
+    // in the image and not on which thread happened to render it.
+
+    uint64_t key = frame_seed;
+    key = splitmix64(key) ^ pixel_index;
+    key = splitmix64(key) ^ sample_index;
+    thread_rng().seed(splitmix64(key));
+}
+
+inline double uniform_double(uint64_t bits) {
+    // Maps the top 53 bits of a random word to a double in [0,1).
+    return double(bits >> 11) * 0x1.0p-53;
+}
+
+
+class sampler {
+  public:
+    // A sequence of sample points in [0,1)^n for each pixel, such as a low-discrepancy
+    // sequence. Coordinate `dimension` of sample `sample_index` of a pixel is a pure function
+    // of its arguments, so samples can be drawn in any order and from any thread.
+    virtual ~sampler() = default;
+
+    virtual double value(uint64_t pixel_index, uint64_t sample_index, unsigned dimension) const
+        = 0;
+};
+
+
+class sample_stream {
+  public:
+    // The sample a thread is currently tracing, and the window of its dimensions that the next
+    // random numbers come from. Draws past the end of the window, or with no sampler at all,
+    // come from the thread's generator instead.
+    const sampler* source = nullptr;
+    uint64_t pixel_index = 0;
+    uint64_t sample_index = 0;
+    unsigned dimension = 0;
+    unsigned end = 0;
+
+    bool active() const { return dimension < end; }
+
+    double next() { return source->value(pixel_index, sample_index, dimension++); }
+};
+
+inline sample_stream& thread_sample_stream() {
+    thread_local sample_stream stream;
+    return stream;
+}
+
+inline void begin_sample_stream(const sampler* source, uint64_t pixel_index,
+                                uint64_t sample_index) {
+    // Starts drawing from the given sample of a pixel, or only from the generator if source is
+    // null. No dimensions are drawn until set_sample_dimensions() opens a window.
+    auto& stream = thread_sample_stream();
+    stream.source = source;
+    stream.pixel_index = pixel_index;
+    stream.sample_index = sample_index;
+    stream.dimension = stream.end = 0;
+}
+
+inline void set_sample_dimensions(unsigned first, unsigned count) {
+    // Makes the next count random numbers the thread draws come from dimensions first,
+    // first+1, ... of its current sample. A count of zero closes the window. Each dimension
+    // should feed one decision of a path, so that no two decisions share a value.
+    auto& stream = thread_sample_stream();
+    stream.dimension = first;
+    stream.end = (stream.source != nullptr) ? first + count : first;
+}
+
+inline double next_uniform_double() {
+    // The next random real in [0,1), from the sample window if one is open.
+    auto& stream = thread_sample_stream();
+    if (stream.active())
+        return stream.next();
+    return uniform_double(thread_rng().next_u64());
+}
+
+inline void random_doubles(double* out, size_t count) {
+    // Fills out[0..count) with random reals in [0,1), keeping the generator state in registers
+    // for the whole batch.
+    auto& stream = thread_sample_stream();
+    size_t i = 0;
+    for (; i < count && stream.active(); i++)
+        out[i] = stream.next();
+
+    if (i == count)
+        return;
+
+    auto engine = thread_rng();
+    for (; i < count; i++)
+        out[i] = uniform_double(engine.next_u64());
+    thread_rng() = engine;
+}
+
+
+#endif
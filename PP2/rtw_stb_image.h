@@ -87,6 +87,18 @@ class rtw_image {
         return bdata + y*bytes_per_scanline + x*bytes_per_pixel;
     }
 
+    const float* linear_pixel_data(int x, int y) const {
+        // Return the address of the three linear RGB floats of the pixel at x,y, which for HDR
+        // images are not limited to [0,1]. If there is no image data, returns magenta.
+        static float magenta[] = { 1, 0, 1 };
+        if (fdata == nullptr) return magenta;
+
+        x = clamp(x, 0, image_width);
+        y = clamp(y, 0, image_height);
+
+        return fdata + y*bytes_per_scanline + x*bytes_per_pixel;
+    }
+
   private:
     const int      bytes_per_pixel = 3;
     float         *fdata = nullptr;         // Linear floating point pixel data
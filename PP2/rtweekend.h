@@ -15,6 +15,8 @@
 #include <limits>
 #include <memory>
 
+#include "rng.h"
+
 
 // C++ Std Usings
 
@@ -35,8 +37,9 @@ inline double degrees_to_radians(double degrees) {
 }
 
 inline double random_double() {
-    // Returns a random real in [0,1).
-    return std::rand() / (RAND_MAX + 1.0);
+    // Returns a random real in [0,1), drawn from the calling thread's current sample (see
+    // set_sample_dimensions()) or its generator.
+    return next_uniform_double();
 }
 
 inline double random_double(double min, double max) {
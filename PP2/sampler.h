@@ -0,0 +1,182 @@
+#ifndef SAMPLER_H
+#define SAMPLER_H
+//==============================================================================================
+// To the extent possible under law, the author(s) have dedicated all copyright and related and
+// neighboring rights to this software to the public domain worldwide. This software is
+// distributed without any warranty.
+//
+// You should have received a copy (see file COPYING.txt) of the CC0 Public Domain Dedication
+// along with this software. If not, see <http://creativecommons.org/publicdomain/zero/1.0/>.
+//==============================================================================================
+
+#include "rtweekend.h"
+
+#include <cstdint>
+
+
+// The samplers below are randomized per pixel and per dimension from a hash of the frame seed,
+// the pixel and the dimension, so every sample value is uniformly distributed on its own and
+// estimates stay unbiased, while the samples of one pixel are spread out evenly together.
+
+inline uint64_t sample_hash(uint64_t seed, uint64_t a, uint64_t b) {
+    auto key = splitmix64(seed) ^ a;
+    key = splitmix64(key) ^ b;
+    return splitmix64(key);
+}
+
+inline uint32_t permute(uint32_t i, uint32_t l, uint32_t p) {
+    // Kensler's hash-based permutation of [0,l): the p-th of a family of shuffles, found by
+    // a keyed bijection on the next power of two and cycle-walking back into range.
+    uint32_t w = l - 1;
+    w |= w >> 1;
+    w |= w >> 2;
+    w |= w >> 4;
+    w |= w >> 8;
+    w |= w >> 16;
+    do {
+        i ^= p;             i *= 0xe170893d;
+        i ^= p >> 16;
+        i ^= (i & w) >> 4;
+        i ^= p >> 8;        i *= 0x0929eb3f;
+        i ^= p >> 23;
+        i ^= (i & w) >> 1;  i *= 1 | p >> 27;
+                            i *= 0x6935fa69;
+        i ^= (i & w) >> 11; i *= 0x74dcb303;
+        i ^= (i & w) >> 2;  i *= 0x9e501cc3;
+        i ^= (i & w) >> 2;  i *= 0xc860a3df;
+        i &= w;
+        i ^= i >> 5;
+    } while (i >= l);
+    return (i + p) % l;
+}
+
+
+class stratified_sampler : public sampler {
+  public:
+    // Jittered stratification of each dimension: the n = samples_per_pixel samples of a pixel
+    // fall one in each of n equal strata of every dimension, in an order shuffled separately
+    // per dimension (a Latin hypercube). Further rounds of n samples are shuffled afresh.
+
+    stratified_sampler(int samples_per_pixel, uint64_t seed)
+      : strata(uint32_t(std::max(samples_per_pixel, 1))), seed(seed) {}
+
+    double value(uint64_t pixel_index, uint64_t sample_index, unsigned dimension) const override {
+        auto round = sample_index / strata;
+        auto key = sample_hash(seed ^ round, pixel_index, dimension);
+        auto i = uint32_t(sample_index % strata);
+
+        auto stratum = permute(i, strata, uint32_t(key));
+        auto jitter = uniform_double(sample_hash(key, i, 0));
+        return (stratum + jitter) / strata;
+    }
+
+  private:
+    uint32_t strata;
+    uint64_t seed;
+};
+
+
+class halton_sampler : public sampler {
+  public:
+    // The Halton sequence, whose dimension d is the radical inverse of the sample index in the
+    // d-th prime base, with the digits of each place shuffled by a random permutation per
+    // pixel, dimension and place. Unscrambled, neighbouring large bases put their first samples
+    // along lines, worse than independent ones; the permutations break those lines up.
+    // Dimensions past the prime table fall back to independent values.
+
+    halton_sampler(uint64_t seed) : seed(seed) {}
+
+    double value(uint64_t pixel_index, uint64_t sample_index, unsigned dimension) const override {
+        auto key = sample_hash(seed, pixel_index, dimension);
+        if (dimension >= prime_count)
+            return uniform_double(sample_hash(key, sample_index, 1));
+
+        return scrambled_radical_inverse(primes[dimension], sample_index, key);
+    }
+
+  private:
+    static const unsigned prime_count = 64;
+    static constexpr uint32_t primes[prime_count] = {
+          2,   3,   5,   7,  11,  13,  17,  19,  23,  29,  31,  37,  41,  43,  47,  53,
+         59,  61,  67,  71,  73,  79,  83,  89,  97, 101, 103, 107, 109, 113, 127, 131,
+        137, 139, 149, 151, 157, 163, 167, 173, 179, 181, 191, 193, 197, 199, 211, 223,
+        227, 229, 233, 239, 241, 251, 257, 263, 269, 271, 277, 281, 283, 293, 307, 311
+    };
+
+    uint64_t seed;
+
+    static double scrambled_radical_inverse(uint32_t base, uint64_t index, uint64_t key) {
+        // Mirrors the base-b digits of index around the radix point, permuting each one. The
+        // zero digits past the last one of index would permute to a fixed random tail, which is
+        // replaced by a uniform offset within the smallest interval reached; this jitters each
+        // sample inside its stratum without changing the distribution.
+        double inverse_base = 1.0 / base, scale = 1, result = 0;
+        auto digits = index;
+        for (uint32_t place = 0; digits > 0; place++) {
+            scale *= inverse_base;
+            auto permutation = uint32_t(sample_hash(key, place, 3));
+            result += permute(uint32_t(digits % base), base, permutation) * scale;
+            digits /= base;
+        }
+        result += scale * uniform_double(sample_hash(key, index, 2));
+        return std::fmin(result, 1 - 0x1.0p-53);
+    }
+};
+
+
+class sobol_sampler : public sampler {
+  public:
+    // Owen-scrambled Sobol points, in the shuffled and scrambled form of Burley's "Practical
+    // Hash-based Owen Scrambling" (2020): dimensions are taken in pairs, each pair is the first
+    // two Sobol dimensions, and the sample index is shuffled per pixel and pair so that pairs
+    // don't correlate. Only two sets of direction numbers are needed, for any number of
+    // dimensions, and every prefix of a pixel's samples is well stratified, which suits
+    // progressive and adaptive rendering.
+
+    sobol_sampler(uint64_t seed) : seed(seed) {}
+
+    double value(uint64_t pixel_index, uint64_t sample_index, unsigned dimension) const override {
+        auto key = sample_hash(seed, pixel_index, dimension / 2);
+        auto index = nested_uniform_scramble(uint32_t(sample_index), uint32_t(key));
+        auto bits = (dimension % 2 == 0) ? reverse_bits(index) : sobol_second(index);
+        bits = nested_uniform_scramble(bits, uint32_t(key >> 32) + dimension % 2);
+        return bits * 0x1.0p-32;
+    }
+
+  private:
+    uint64_t seed;
+
+    static uint32_t reverse_bits(uint32_t x) {
+        x = (x << 16) | (x >> 16);
+        x = ((x & 0x00ff00ff) << 8) | ((x & 0xff00ff00) >> 8);
+        x = ((x & 0x0f0f0f0f) << 4) | ((x & 0xf0f0f0f0) >> 4);
+        x = ((x & 0x33333333) << 2) | ((x & 0xcccccccc) >> 2);
+        x = ((x & 0x55555555) << 1) | ((x & 0xaaaaaaaa) >> 1);
+        return x;
+    }
+
+    static uint32_t sobol_second(uint32_t index) {
+        // The second Sobol dimension (primitive polynomial x + 1). Its direction numbers start
+        // at the top bit, each one the previous XOR the previous shifted right by one.
+        uint32_t result = 0;
+        for (uint32_t v = 1u << 31; index != 0; index >>= 1, v ^= v >> 1)
+            if (index & 1)
+                result ^= v;
+        return result;
+    }
+
+    static uint32_t nested_uniform_scramble(uint32_t x, uint32_t seed) {
+        // Owen scrambling (a random flip of each digit, keyed on the digits above it), done
+        // with Laine and Karras's hash on the bit-reversed value.
+        x = reverse_bits(x);
+        x += seed;
+        x ^= x * 0x6c50b47c;
+        x ^= x * 0xb82f1e52;
+        x ^= x * 0xc7afe638;
+        x ^= x * 0x8d22f6e6;
+        return reverse_bits(x);
+    }
+};
+
+
+#endif
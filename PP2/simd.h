@@ -0,0 +1,61 @@
+#ifndef SIMD_H
+#define SIMD_H
+//==============================================================================================
+// To the extent possible under law, the author(s) have dedicated all copyright and related and
+// neighboring rights to this software to the public domain worldwide. This software is
+// distributed without any warranty.
+//
+// You should have received a copy (see file COPYING.txt) of the CC0 Public Domain Dedication
+// along with this software. If not, see <http://creativecommons.org/publicdomain/zero/1.0/>.
+//==============================================================================================
+
+// Support for the SIMD code paths. Builds target the baseline instruction set (SSE2 on x86-64),
+// and functions that use AVX2 are compiled for it individually with RTW_TARGET_AVX2, so they
+// must only be called after checking at run time that the CPU supports them.
+
+#if defined(__x86_64__) || defined(_M_X64)
+    #define RTW_SIMD_X86 1
+    #include <immintrin.h>
+#else
+    #define RTW_SIMD_X86 0
+#endif
+
+#if RTW_SIMD_X86 && (defined(__GNUC__) || defined(__clang__))
+    #define RTW_SIMD_AVX2 1
+    #define RTW_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+    #define RTW_SIMD_AVX2 0
+    #define RTW_TARGET_AVX2
+#endif
+
+
+enum class simd_level {
+    scalar,  // Portable C++
+    sse2,    // Two doubles per register
+    avx2     // Four doubles per register
+};
+
+
+inline simd_level detected_simd_level() {
+    // The widest instruction set both this build and the CPU support.
+  #if RTW_SIMD_AVX2
+    if (__builtin_cpu_supports("avx2"))
+        return simd_level::avx2;
+  #endif
+  #if RTW_SIMD_X86
+    return simd_level::sse2;
+  #else
+    return simd_level::scalar;
+  #endif
+}
+
+
+inline simd_level& active_simd_level() {
+    // The level the SIMD code paths dispatch on. It starts at the detected level. Lowering it
+    // is useful to compare the code paths; raising it past the detected level is not safe.
+    static simd_level level = detected_simd_level();
+    return level;
+}
+
+
+#endif
@@ -12,6 +12,7 @@
 //==============================================================================================
 
 #include "hittable.h"
+#include "onb.h"
 
 
 class sphere : public hittable {
@@ -62,13 +63,63 @@ class sphere : public hittable {
         rec.set_face_normal(r, outward_normal);
         get_sphere_uv(outward_normal, rec.u, rec.v);
         rec.mat = mat;
+        rec.object = this;
 
         return true;
     }
 
+    bool occluded(const ray& r, interval ray_t) const override {
+        vec3 oc = center.at(r.time()) - r.origin();
+        auto a = r.direction().length_squared();
+        auto h = dot(r.direction(), oc);
+        auto c = oc.length_squared() - radius*radius;
+
+        auto discriminant = h*h - a*c;
+        if (discriminant < 0)
+            return false;
+
+        auto sqrtd = std::sqrt(discriminant);
+        return ray_t.surrounds((h - sqrtd) / a) || ray_t.surrounds((h + sqrtd) / a);
+    }
+
     aabb bounding_box() const override { return bbox; }
 
+    aabb bounding_box_at(double time) const override {
+        auto rvec = vec3(radius, radius, radius);
+        return aabb(center.at(time) - rvec, center.at(time) + rvec);
+    }
+
+    shared_ptr<material> light_material() const override { return mat; }
+
+    double pdf_value(const point3& origin, const vec3& direction, double time) const override {
+        // Directions are drawn uniformly from the cone the sphere subtends, as seen from origin.
+        if (!occluded(ray(origin, direction, time), interval(0.001, infinity)))
+            return 0;
+
+        auto distance_squared = (center.at(time) - origin).length_squared();
+        if (distance_squared <= radius*radius)
+            return 0;
+
+        auto cos_theta_max = std::sqrt(1 - radius*radius/distance_squared);
+        auto solid_angle = 2*pi*(1 - cos_theta_max);
+        return 1 / solid_angle;
+    }
+
+    double surface_area() const override { return 4*pi*radius*radius; }
+
+    vec3 random(const point3& origin, double time) const override {
+        vec3 direction = center.at(time) - origin;
+        auto distance_squared = direction.length_squared();
+        if (distance_squared <= radius*radius)
+            return random_unit_vector();
+
+        onb uvw(direction);
+        return uvw.transform(random_to_sphere(radius, distance_squared));
+    }
+
   private:
+    friend class sphere_packet;  // Copies the center, motion and radius into its SIMD layout
+
     ray center;
     double radius;
     shared_ptr<material> mat;
@@ -88,6 +139,20 @@ class sphere : public hittable {
         u = phi / (2*pi);
         v = theta / pi;
     }
+
+    static vec3 random_to_sphere(double radius, double distance_squared) {
+        // A direction uniformly distributed over the cone, around +Z, that a sphere of the
+        // given radius subtends from distance_squared away.
+        auto r1 = random_double();
+        auto r2 = random_double();
+        auto z = 1 + r2*(std::sqrt(1 - radius*radius/distance_squared) - 1);
+
+        auto phi = 2*pi*r1;
+        auto x = std::cos(phi) * std::sqrt(1 - z*z);
+        auto y = std::sin(phi) * std::sqrt(1 - z*z);
+
+        return vec3(x, y, z);
+    }
 };
 
 
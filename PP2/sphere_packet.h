@@ -0,0 +1,242 @@
+#ifndef SPHERE_PACKET_H
+#define SPHERE_PACKET_H
+//==============================================================================================
+// To the extent possible under law, the author(s) have dedicated all copyright and related and
+// neighboring rights to this software to the public domain worldwide. This software is
+// distributed without any warranty.
+//
+// You should have received a copy (see file COPYING.txt) of the CC0 Public Domain Dedication
+// along with this software. If not, see <http://creativecommons.org/publicdomain/zero/1.0/>.
+//==============================================================================================
+
+#include "simd.h"
+#include "sphere.h"
+
+#include <typeinfo>
+
+
+class sphere_packet {
+  public:
+    // Up to four spheres, static or moving, stored as a structure of arrays so that one ray is
+    // tested against all of them at once with SIMD instructions (AVX2 or SSE2, picked at run
+    // time). Only the closest hit gets its normal and texture coordinates computed.
+
+    static const int width = 4;
+
+    static bool packable(const hittable& object) {
+        return typeid(object) == typeid(sphere);
+    }
+
+    sphere_packet() {
+        // Empty lanes have a negative squared radius, which makes the discriminant negative for
+        // every ray, so they never hit.
+        for (int i = 0; i < width; i++) {
+            cx[i] = cy[i] = cz[i] = 0;
+            mx[i] = my[i] = mz[i] = 0;
+            r2[i] = -1;
+            spheres[i] = nullptr;
+        }
+    }
+
+    int size() const { return count; }
+
+    void add(const sphere& s) {
+        if (count >= width)
+            return;
+
+        const auto& c = s.center.origin();
+        const auto& m = s.center.direction();
+        cx[count] = c.x(); cy[count] = c.y(); cz[count] = c.z();
+        mx[count] = m.x(); my[count] = m.y(); mz[count] = m.z();
+        r2[count] = s.radius * s.radius;
+        spheres[count] = &s;
+        count++;
+    }
+
+    bool hit(const ray& r, const interval& ray_t, hit_record& rec) const {
+        // Misses get an infinite distance in the lane outputs.
+        alignas(32) double t[width];
+        intersect(r, ray_t, t);
+
+        int lane = -1;
+        double closest = infinity;
+        for (int i = 0; i < width; i++) {
+            if (t[i] < closest) {
+                closest = t[i];
+                lane = i;
+            }
+        }
+
+        if (lane < 0)
+            return false;
+
+        const auto& s = *spheres[lane];
+        point3 current_center = s.center.at(r.time());
+
+        rec.t = closest;
+        rec.p = r.at(rec.t);
+        vec3 outward_normal = (rec.p - current_center) / s.radius;
+        rec.set_face_normal(r, outward_normal);
+        sphere::get_sphere_uv(outward_normal, rec.u, rec.v);
+        rec.mat = s.mat;
+        rec.object = &s;
+
+        return true;
+    }
+
+    bool occluded(const ray& r, const interval& ray_t) const {
+        alignas(32) double t[width];
+        intersect(r, ray_t, t);
+        for (int i = 0; i < width; i++) {
+            if (t[i] < infinity)
+                return true;
+        }
+        return false;
+    }
+
+  private:
+    alignas(32) double cx[width], cy[width], cz[width];  // Center at time 0
+    alignas(32) double mx[width], my[width], mz[width];  // Center motion from time 0 to 1
+    alignas(32) double r2[width];                        // Squared radius
+    const sphere* spheres[width];
+    int count = 0;
+
+    void intersect(const ray& r, const interval& ray_t, double* t) const {
+        switch (active_simd_level()) {
+          #if RTW_SIMD_AVX2
+            case simd_level::avx2: intersect_avx2(r, ray_t, t); break;
+          #endif
+          #if RTW_SIMD_X86
+            case simd_level::sse2: intersect_sse2(r, ray_t, t); break;
+          #endif
+            default:               intersect_scalar(r, ray_t, t); break;
+        }
+    }
+
+    // Each lane solves the same quadratic as sphere::hit(), taking the nearer root if it lies
+    // strictly inside the ray interval and the farther one otherwise.
+
+    void intersect_scalar(const ray& r, const interval& ray_t, double* t) const {
+        const auto& o = r.origin();
+        const auto& dir = r.direction();
+        auto time = r.time();
+        auto a = dir.length_squared();
+
+        for (int i = 0; i < width; i++) {
+            auto ocx = cx[i] + time*mx[i] - o.x();
+            auto ocy = cy[i] + time*my[i] - o.y();
+            auto ocz = cz[i] + time*mz[i] - o.z();
+            auto h = dir.x()*ocx + dir.y()*ocy + dir.z()*ocz;
+            auto c = (ocx*ocx + ocy*ocy + ocz*ocz) - r2[i];
+
+            t[i] = infinity;
+            auto discriminant = h*h - a*c;
+            if (discriminant < 0)
+                continue;
+
+            auto sqrtd = std::sqrt(discriminant);
+            auto root = (h - sqrtd) / a;
+            if (!ray_t.surrounds(root)) {
+                root = (h + sqrtd) / a;
+                if (!ray_t.surrounds(root))
+                    continue;
+            }
+            t[i] = root;
+        }
+    }
+
+  #if RTW_SIMD_X86
+    void intersect_sse2(const ray& r, const interval& ray_t, double* t) const {
+        const auto& o = r.origin();
+        const auto& dir = r.direction();
+        const auto time = _mm_set1_pd(r.time());
+        const auto ox = _mm_set1_pd(o.x());
+        const auto oy = _mm_set1_pd(o.y());
+        const auto oz = _mm_set1_pd(o.z());
+        const auto dx = _mm_set1_pd(dir.x());
+        const auto dy = _mm_set1_pd(dir.y());
+        const auto dz = _mm_set1_pd(dir.z());
+        const auto a = _mm_set1_pd(dir.length_squared());
+        const auto t_min = _mm_set1_pd(ray_t.min);
+        const auto t_max = _mm_set1_pd(ray_t.max);
+        const auto inf = _mm_set1_pd(infinity);
+
+        for (int i = 0; i < width; i += 2) {
+            auto center_x = _mm_add_pd(_mm_load_pd(cx + i), _mm_mul_pd(time, _mm_load_pd(mx + i)));
+            auto center_y = _mm_add_pd(_mm_load_pd(cy + i), _mm_mul_pd(time, _mm_load_pd(my + i)));
+            auto center_z = _mm_add_pd(_mm_load_pd(cz + i), _mm_mul_pd(time, _mm_load_pd(mz + i)));
+            auto ocx = _mm_sub_pd(center_x, ox);
+            auto ocy = _mm_sub_pd(center_y, oy);
+            auto ocz = _mm_sub_pd(center_z, oz);
+
+            auto h = _mm_add_pd(_mm_add_pd(_mm_mul_pd(dx, ocx), _mm_mul_pd(dy, ocy)),
+                                _mm_mul_pd(dz, ocz));
+            auto oc2 = _mm_add_pd(_mm_add_pd(_mm_mul_pd(ocx, ocx), _mm_mul_pd(ocy, ocy)),
+                                  _mm_mul_pd(ocz, ocz));
+            auto c = _mm_sub_pd(oc2, _mm_load_pd(r2 + i));
+
+            // A negative discriminant gives a NaN square root, which fails every comparison.
+            auto sqrtd = _mm_sqrt_pd(_mm_sub_pd(_mm_mul_pd(h, h), _mm_mul_pd(a, c)));
+            auto near_root = _mm_div_pd(_mm_sub_pd(h, sqrtd), a);
+            auto far_root = _mm_div_pd(_mm_add_pd(h, sqrtd), a);
+
+            auto near_ok = _mm_and_pd(_mm_cmpgt_pd(near_root, t_min),
+                                      _mm_cmplt_pd(near_root, t_max));
+            auto far_ok = _mm_and_pd(_mm_cmpgt_pd(far_root, t_min),
+                                     _mm_cmplt_pd(far_root, t_max));
+
+            auto root = _mm_or_pd(_mm_and_pd(far_ok, far_root), _mm_andnot_pd(far_ok, inf));
+            root = _mm_or_pd(_mm_and_pd(near_ok, near_root), _mm_andnot_pd(near_ok, root));
+            _mm_store_pd(t + i, root);
+        }
+    }
+  #endif
+
+  #if RTW_SIMD_AVX2
+    RTW_TARGET_AVX2
+    void intersect_avx2(const ray& r, const interval& ray_t, double* t) const {
+        const auto& o = r.origin();
+        const auto& dir = r.direction();
+        const auto time = _mm256_set1_pd(r.time());
+        const auto ox = _mm256_set1_pd(o.x());
+        const auto oy = _mm256_set1_pd(o.y());
+        const auto oz = _mm256_set1_pd(o.z());
+        const auto dx = _mm256_set1_pd(dir.x());
+        const auto dy = _mm256_set1_pd(dir.y());
+        const auto dz = _mm256_set1_pd(dir.z());
+        const auto a = _mm256_set1_pd(dir.length_squared());
+        const auto t_min = _mm256_set1_pd(ray_t.min);
+        const auto t_max = _mm256_set1_pd(ray_t.max);
+
+        auto center_x = _mm256_add_pd(_mm256_load_pd(cx), _mm256_mul_pd(time, _mm256_load_pd(mx)));
+        auto center_y = _mm256_add_pd(_mm256_load_pd(cy), _mm256_mul_pd(time, _mm256_load_pd(my)));
+        auto center_z = _mm256_add_pd(_mm256_load_pd(cz), _mm256_mul_pd(time, _mm256_load_pd(mz)));
+        auto ocx = _mm256_sub_pd(center_x, ox);
+        auto ocy = _mm256_sub_pd(center_y, oy);
+        auto ocz = _mm256_sub_pd(center_z, oz);
+
+        auto h = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(dx, ocx), _mm256_mul_pd(dy, ocy)),
+                               _mm256_mul_pd(dz, ocz));
+        auto oc2 = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(ocx, ocx), _mm256_mul_pd(ocy, ocy)),
+                                 _mm256_mul_pd(ocz, ocz));
+        auto c = _mm256_sub_pd(oc2, _mm256_load_pd(r2));
+
+        // A negative discriminant gives a NaN square root, which fails every comparison.
+        auto sqrtd = _mm256_sqrt_pd(_mm256_sub_pd(_mm256_mul_pd(h, h), _mm256_mul_pd(a, c)));
+        auto near_root = _mm256_div_pd(_mm256_sub_pd(h, sqrtd), a);
+        auto far_root = _mm256_div_pd(_mm256_add_pd(h, sqrtd), a);
+
+        auto near_ok = _mm256_and_pd(_mm256_cmp_pd(near_root, t_min, _CMP_GT_OQ),
+                                     _mm256_cmp_pd(near_root, t_max, _CMP_LT_OQ));
+        auto far_ok = _mm256_and_pd(_mm256_cmp_pd(far_root, t_min, _CMP_GT_OQ),
+                                    _mm256_cmp_pd(far_root, t_max, _CMP_LT_OQ));
+
+        auto root = _mm256_blendv_pd(_mm256_set1_pd(infinity), far_root, far_ok);
+        root = _mm256_blendv_pd(root, near_root, near_ok);
+        _mm256_store_pd(t, root);
+    }
+  #endif
+};
+
+
+#endif
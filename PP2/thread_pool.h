@@ -0,0 +1,161 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+//==============================================================================================
+// To the extent possible under law, the author(s) have dedicated all copyright and related and
+// neighboring rights to this software to the public domain worldwide. This software is
+// distributed without any warranty.
+//
+// You should have received a copy (see file COPYING.txt) of the CC0 Public Domain Dedication
+// along with this software. If not, see <http://creativecommons.org/publicdomain/zero/1.0/>.
+//==============================================================================================
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+class thread_pool {
+  public:
+    // Signature of a job: called once per task index, along with the index of the worker
+    // thread running it (useful for per-thread scratch state).
+    using task_function = std::function<void(int task, int worker)>;
+
+    thread_pool(int thread_count) : queues(thread_count < 1 ? 1 : thread_count) {
+        for (int i = 0; i < int(queues.size()); i++)
+            workers.emplace_back([this, i] { worker_loop(i); });
+    }
+
+    ~thread_pool() {
+        {
+            std::lock_guard<std::mutex> lock(state_mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+
+        for (auto& worker : workers)
+            worker.join();
+    }
+
+    thread_pool(const thread_pool&) = delete;
+    thread_pool& operator=(const thread_pool&) = delete;
+
+    int size() const { return int(workers.size()); }
+
+    void run(int task_count, const task_function& job) {
+        // Runs job(task, worker) for every task in [0, task_count) and blocks until all of them
+        // have finished. Tasks are dealt round-robin into the per-worker queues; a worker that
+        // drains its own queue steals from the back of the others, so uneven tasks still keep
+        // every thread busy until the very end.
+
+        if (task_count <= 0)
+            return;
+
+        {
+            std::lock_guard<std::mutex> lock(state_mutex);
+
+            for (int task = 0; task < task_count; task++) {
+                auto& queue = queues[task % queues.size()];
+                std::lock_guard<std::mutex> queue_lock(queue.mutex);
+                queue.tasks.push_back(task);
+            }
+
+            current_job = &job;
+            remaining = task_count;
+            generation++;
+        }
+        wake.notify_all();
+
+        std::unique_lock<std::mutex> lock(state_mutex);
+        done.wait(lock, [this] { return remaining == 0 && active == 0; });
+        current_job = nullptr;
+    }
+
+  private:
+    struct work_queue {
+        std::mutex mutex;
+        std::deque<int> tasks;
+    };
+
+    std::vector<work_queue> queues;    // One task deque per worker
+    std::vector<std::thread> workers;
+
+    std::mutex state_mutex;
+    std::condition_variable wake;      // Signals workers that a new job (or shutdown) is ready
+    std::condition_variable done;      // Signals run() that the last task has finished
+    const task_function* current_job = nullptr;
+    unsigned long generation = 0;      // Bumped once per call to run()
+    int remaining = 0;                 // Tasks of the current job not yet finished
+    int active = 0;                    // Workers currently pulling tasks for the current job
+    bool stopping = false;
+
+    void worker_loop(int id) {
+        unsigned long seen_generation = 0;
+
+        while (true) {
+            const task_function* job;
+            {
+                std::unique_lock<std::mutex> lock(state_mutex);
+                wake.wait(lock, [&] { return stopping || generation != seen_generation; });
+                if (stopping)
+                    return;
+
+                seen_generation = generation;
+                job = current_job;
+
+                // A worker that wakes up after the job it was signalled for has already been
+                // completed must not touch the queues, which may be refilled at any moment.
+                if (job == nullptr)
+                    continue;
+
+                active++;
+            }
+
+            int task;
+            while (next_task(id, task)) {
+                (*job)(task, id);
+
+                std::lock_guard<std::mutex> lock(state_mutex);
+                remaining--;
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(state_mutex);
+                active--;
+                if (remaining == 0 && active == 0)
+                    done.notify_all();
+            }
+        }
+    }
+
+    bool next_task(int id, int& task) {
+        // Pop from the front of our own queue first, which keeps neighbouring tasks together.
+        {
+            auto& own = queues[id];
+            std::lock_guard<std::mutex> lock(own.mutex);
+            if (!own.tasks.empty()) {
+                task = own.tasks.front();
+                own.tasks.pop_front();
+                return true;
+            }
+        }
+
+        // Otherwise steal from the back of the other workers' queues.
+        for (size_t offset = 1; offset < queues.size(); offset++) {
+            auto& victim = queues[(id + offset) % queues.size()];
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            if (!victim.tasks.empty()) {
+                task = victim.tasks.back();
+                victim.tasks.pop_back();
+                return true;
+            }
+        }
+
+        return false;
+    }
+};
+
+
+#endif
@@ -0,0 +1,328 @@
+#ifndef TRIANGLE_MESH_H
+#define TRIANGLE_MESH_H
+//==============================================================================================
+// To the extent possible under law, the author(s) have dedicated all copyright and related and
+// neighboring rights to this software to the public domain worldwide. This software is
+// distributed without any warranty.
+//
+// You should have received a copy (see file COPYING.txt) of the CC0 Public Domain Dedication
+// along with this software. If not, see <http://creativecommons.org/publicdomain/zero/1.0/>.
+//==============================================================================================
+
+#include "hittable.h"
+#include "linear_bvh.h"
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+
+class texcoord {
+  public:
+    double u, v;
+};
+
+
+class triangle_mesh : public hittable {
+  public:
+    // A mesh of triangles sharing one material. Vertex attributes are stored once in shared
+    // buffers and every triangle is just three indices into them. The normal and UV buffers
+    // are optional; when present they must have one entry per position. Without them the
+    // geometric normal and the triangle's barycentric coordinates are used.
+
+    triangle_mesh(
+        std::vector<point3> positions, std::vector<uint32_t> indices, shared_ptr<material> mat,
+        std::vector<vec3> normals = {}, std::vector<texcoord> uvs = {}
+    ) : positions(std::move(positions)), normals(std::move(normals)), uvs(std::move(uvs)),
+        mat(mat)
+    {
+        auto start_time = std::chrono::steady_clock::now();
+
+        if (this->normals.size() != this->positions.size()) this->normals.clear();
+        if (this->uvs.size() != this->positions.size()) this->uvs.clear();
+
+        // Drop any trailing partial triangle, and triangles that reference missing vertices.
+        for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+            std::array<uint32_t,3> tri = { indices[i], indices[i+1], indices[i+2] };
+            if (tri[0] < this->positions.size() && tri[1] < this->positions.size()
+                && tri[2] < this->positions.size())
+                triangles.push_back(tri);
+        }
+
+        std::vector<aabb> boxes;
+        boxes.reserve(triangles.size());
+        for (const auto& tri : triangles) {
+            const auto& a = this->positions[tri[0]];
+            const auto& b = this->positions[tri[1]];
+            const auto& c = this->positions[tri[2]];
+            boxes.push_back(aabb(aabb(a, b), aabb(c, c)));
+        }
+
+        // A high node cost makes the SAH settle for leaves of several triangles. That keeps
+        // the BVH to roughly a third of a 64-byte node per triangle, and is also faster to
+        // traverse than a tree of one-triangle leaves.
+        bvh_build_options options;
+        options.split = bvh_split_method::sah;
+        options.traversal_cost = 4.0;
+
+        std::vector<int> order;
+        auto cost = build_linear_bvh(boxes, options, 8, nodes, order);
+
+        // Store the triangles in leaf order, so that a leaf references a contiguous range.
+        std::vector<std::array<uint32_t,3>> ordered;
+        ordered.reserve(order.size());
+        for (auto index : order)
+            ordered.push_back(triangles[index]);
+        triangles.swap(ordered);
+
+        bbox = nodes.empty() ? aabb::empty : nodes[0].bbox;
+
+        std::chrono::duration<double, std::milli> elapsed =
+            std::chrono::steady_clock::now() - start_time;
+
+        std::clog << "Triangle mesh: " << triangles.size() << " triangles, "
+                  << this->positions.size() << " vertices, " << memory_per_triangle()
+                  << " bytes per triangle, SAH cost " << cost << ", built in "
+                  << elapsed.count() << " ms\n";
+    }
+
+    static shared_ptr<triangle_mesh> load_obj(const char* filename, shared_ptr<material> mat) {
+        // Loads the triangles of a Wavefront OBJ file, triangulating polygons as fans. Only
+        // v, vt, vn and f statements are read. If the file cannot be read, an error is printed
+        // and the mesh is empty. Face corners with unreadable indices are left out of their
+        // faces, with an error.
+
+        std::ifstream file(filename);
+        if (!file)
+            std::cerr << "ERROR: Could not load mesh file '" << filename << "'.\n";
+
+        std::vector<point3> file_positions;
+        std::vector<texcoord> file_uvs;
+        std::vector<vec3> file_normals;
+
+        std::vector<point3> positions;
+        std::vector<texcoord> uvs;
+        std::vector<vec3> normals;
+        std::vector<uint32_t> indices;
+        std::map<std::array<long,3>, uint32_t> vertex_ids;  // (v, vt, vn) -> mesh vertex
+        bool has_uvs = true, has_normals = true;
+        long bad_corners = 0;
+
+        auto resolve = [](long index, size_t count) {
+            // OBJ indices are 1-based; negative indices count back from the end.
+            return index < 0 ? long(count) + index : index - 1;
+        };
+
+        std::string line;
+        while (std::getline(file, line)) {
+            std::istringstream in(line.substr(0, line.find('#')));
+            std::string keyword;
+            in >> keyword;
+
+            if (keyword == "v") {
+                double x, y, z;
+                in >> x >> y >> z;
+                file_positions.emplace_back(x, y, z);
+            } else if (keyword == "vt") {
+                texcoord uv = {0, 0};
+                in >> uv.u >> uv.v;
+                file_uvs.push_back(uv);
+            } else if (keyword == "vn") {
+                double x, y, z;
+                in >> x >> y >> z;
+                file_normals.emplace_back(x, y, z);
+            } else if (keyword == "f") {
+                std::vector<uint32_t> face;
+                std::string corner;
+                while (in >> corner) {
+                    std::array<long,3> key = { 0, -1, -1 };
+                    std::istringstream parts(corner);
+                    std::string part;
+                    bool readable = true;
+                    for (int k = 0; k < 3 && std::getline(parts, part, '/'); k++) {
+                        if (part.empty() && k > 0)
+                            continue;
+                        char* end;
+                        auto index = std::strtol(part.c_str(), &end, 10);
+                        if (end == part.c_str() || *end != '\0') {
+                            readable = false;
+                            break;
+                        }
+                        key[k] = resolve(index, k == 0 ? file_positions.size()
+                                              : k == 1 ? file_uvs.size()
+                                                       : file_normals.size());
+                    }
+
+                    if (!readable) {
+                        bad_corners++;
+                        continue;
+                    }
+                    if (key[0] < 0 || key[0] >= long(file_positions.size()))
+                        continue;
+                    if (key[1] < 0 || key[1] >= long(file_uvs.size())) { key[1] = -1; }
+                    if (key[2] < 0 || key[2] >= long(file_normals.size())) { key[2] = -1; }
+
+                    auto found = vertex_ids.find(key);
+                    if (found == vertex_ids.end()) {
+                        found = vertex_ids.emplace(key, uint32_t(positions.size())).first;
+                        positions.push_back(file_positions[key[0]]);
+                        uvs.push_back(key[1] >= 0 ? file_uvs[key[1]] : texcoord{0, 0});
+                        normals.push_back(key[2] >= 0 ? file_normals[key[2]] : vec3());
+                        has_uvs = has_uvs && key[1] >= 0;
+                        has_normals = has_normals && key[2] >= 0;
+                    }
+                    face.push_back(found->second);
+                }
+
+                for (size_t k = 1; k + 1 < face.size(); k++) {
+                    indices.push_back(face[0]);
+                    indices.push_back(face[k]);
+                    indices.push_back(face[k+1]);
+                }
+            }
+        }
+
+        if (bad_corners > 0)
+            std::cerr << "ERROR: Skipped " << bad_corners
+                      << " unreadable face corners in mesh file '" << filename << "'.\n";
+
+        if (!has_uvs) uvs.clear();
+        if (!has_normals) normals.clear();
+
+        return make_shared<triangle_mesh>(
+            std::move(positions), std::move(indices), mat, std::move(normals), std::move(uvs));
+    }
+
+    bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
+        int hit_triangle = -1;
+        double hit_b1 = 0, hit_b2 = 0;
+
+        traverse_linear_bvh(nodes, r, ray_t,
+            [&](int first, int count, interval& t) {
+                bool hit_anything = false;
+                for (int i = first; i < first + count; i++) {
+                    double dist, b1, b2;
+                    if (intersect(triangles[i], r, t, dist, b1, b2)) {
+                        hit_anything = true;
+                        t.max = dist;
+                        hit_triangle = i;
+                        hit_b1 = b1;
+                        hit_b2 = b2;
+                    }
+                }
+                return hit_anything;
+            });
+
+        if (hit_triangle < 0)
+            return false;
+
+        // Only the closest triangle gets its full hit record filled in.
+        const auto& tri = triangles[hit_triangle];
+        const auto& p0 = positions[tri[0]];
+        double b0 = 1 - hit_b1 - hit_b2;
+
+        rec.t = ray_t.max;
+        rec.p = r.at(rec.t);
+        rec.mat = mat;
+        rec.object = this;
+
+        auto geometric_normal = unit_vector(cross(positions[tri[1]] - p0, positions[tri[2]] - p0));
+        rec.set_face_normal(r, geometric_normal);
+
+        if (!normals.empty()) {
+            auto n = b0*normals[tri[0]] + hit_b1*normals[tri[1]] + hit_b2*normals[tri[2]];
+            if (n.length_squared() > 0) {
+                n = unit_vector(n);
+                rec.normal = rec.front_face ? n : -n;
+            }
+        }
+
+        if (!uvs.empty()) {
+            rec.u = b0*uvs[tri[0]].u + hit_b1*uvs[tri[1]].u + hit_b2*uvs[tri[2]].u;
+            rec.v = b0*uvs[tri[0]].v + hit_b1*uvs[tri[1]].v + hit_b2*uvs[tri[2]].v;
+        } else {
+            rec.u = hit_b1;
+            rec.v = hit_b2;
+        }
+
+        return true;
+    }
+
+    bool occluded(const ray& r, interval ray_t) const override {
+        return occluded_linear_bvh(nodes, r, ray_t,
+            [&](int first, int count, const interval& t) {
+                for (int i = first; i < first + count; i++) {
+                    double dist, b1, b2;
+                    if (intersect(triangles[i], r, t, dist, b1, b2))
+                        return true;
+                }
+                return false;
+            });
+    }
+
+    aabb bounding_box() const override { return bbox; }
+
+    size_t triangle_count() const { return triangles.size(); }
+
+    double memory_per_triangle() const {
+        // Bytes of mesh storage (vertex buffers, indices and BVH) per triangle.
+        if (triangles.empty()) return 0;
+        auto bytes = positions.size() * sizeof(point3) + normals.size() * sizeof(vec3)
+                   + uvs.size() * sizeof(texcoord)
+                   + triangles.size() * sizeof(triangles[0])
+                   + nodes.size() * sizeof(linear_bvh_node);
+        return double(bytes) / triangles.size();
+    }
+
+  private:
+    std::vector<point3> positions;
+    std::vector<vec3> normals;
+    std::vector<texcoord> uvs;
+    std::vector<std::array<uint32_t,3>> triangles;
+    std::vector<linear_bvh_node> nodes;
+    shared_ptr<material> mat;
+    aabb bbox;
+
+    bool intersect(
+        const std::array<uint32_t,3>& tri, const ray& r, interval ray_t,
+        double& t, double& b1, double& b2
+    ) const {
+        // Moller-Trumbore ray/triangle intersection. Returns the hit distance and the
+        // barycentric coordinates of the hit relative to the second and third vertices.
+
+        const auto& p0 = positions[tri[0]];
+        auto edge1 = positions[tri[1]] - p0;
+        auto edge2 = positions[tri[2]] - p0;
+
+        auto pvec = cross(r.direction(), edge2);
+        auto det = dot(edge1, pvec);
+
+        // No hit if the ray is parallel to the triangle. The test is exact, because det scales
+        // with the size of the mesh; nearly parallel rays get barycentrics far outside [0,1].
+        if (det == 0)
+            return false;
+
+        auto inv_det = 1.0 / det;
+        auto tvec = r.origin() - p0;
+        b1 = dot(tvec, pvec) * inv_det;
+        if (b1 < 0 || b1 > 1)
+            return false;
+
+        auto qvec = cross(tvec, edge1);
+        b2 = dot(r.direction(), qvec) * inv_det;
+        if (b2 < 0 || b1 + b2 > 1)
+            return false;
+
+        t = dot(edge2, qvec) * inv_det;
+        return ray_t.surrounds(t);
+    }
+};
+
+
+#endif
@@ -60,11 +60,14 @@ class vec3 {
     }
 
     static vec3 random() {
-        return vec3(random_double(), random_double(), random_double());
+        vec3 r;
+        random_doubles(r.e, 3);
+        return r;
     }
 
     static vec3 random(double min, double max) {
-        return vec3(random_double(min,max), random_double(min,max), random_double(min,max));
+        auto r = random();
+        return vec3(min + (max-min)*r.e[0], min + (max-min)*r.e[1], min + (max-min)*r.e[2]);
     }
 };
 
@@ -114,21 +117,39 @@ inline vec3 unit_vector(const vec3& v) {
     return v / v.length();
 }
 
+// The random points and directions below are mapped directly from exactly two random numbers,
+// rather than found by rejection, so that evenly spread sample values (see sampler) give evenly
+// spread points.
+
 inline vec3 random_in_unit_disk() {
-    while (true) {
-        auto p = vec3(random_double(-1,1), random_double(-1,1), 0);
-        if (p.length_squared() < 1)
-            return p;
+    // Shirley and Chiu's concentric mapping, which takes squares around the center of the unit
+    // square to circles around the center of the disk.
+    double xy[2];
+    random_doubles(xy, 2);
+    auto a = 2*xy[0] - 1;
+    auto b = 2*xy[1] - 1;
+    if (a == 0 && b == 0)
+        return vec3(0,0,0);
+
+    double r, theta;
+    if (std::fabs(a) > std::fabs(b)) {
+        r = a;
+        theta = (pi/4) * (b/a);
+    } else {
+        r = b;
+        theta = (pi/2) - (pi/4) * (a/b);
     }
+    return vec3(r*std::cos(theta), r*std::sin(theta), 0);
 }
 
 inline vec3 random_unit_vector() {
-    while (true) {
-        auto p = vec3::random(-1,1);
-        auto lensq = p.length_squared();
-        if (1e-160 < lensq && lensq <= 1.0)
-            return p / sqrt(lensq);
-    }
+    // Uniform on the sphere: the height is uniform in [-1,1] (Archimedes' hat-box theorem).
+    double xy[2];
+    random_doubles(xy, 2);
+    auto z = 1 - 2*xy[0];
+    auto r = std::sqrt(std::fmax(0.0, 1 - z*z));
+    auto phi = 2*pi*xy[1];
+    return vec3(r*std::cos(phi), r*std::sin(phi), z);
 }
 
 inline vec3 random_on_hemisphere(const vec3& normal) {
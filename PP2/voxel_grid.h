@@ -0,0 +1,310 @@
+#ifndef VOXEL_GRID_H
+#define VOXEL_GRID_H
+//==============================================================================================
+// To the extent possible under law, the author(s) have dedicated all copyright and related and
+// neighboring rights to this software to the public domain worldwide. This software is
+// distributed without any warranty.
+//
+// You should have received a copy (see file COPYING.txt) of the CC0 Public Domain Dedication
+// along with this software. If not, see <http://creativecommons.org/publicdomain/zero/1.0/>.
+//==============================================================================================
+
+#include "hittable.h"
+
+#include <cstdint>
+#include <vector>
+
+
+class voxel_block_type {
+  public:
+    // Materials for the faces of one kind of block: the four vertical sides, the top (+Y) and
+    // the bottom (-Y) face.
+    shared_ptr<material> side;
+    shared_ptr<material> top;
+    shared_ptr<material> bottom;
+};
+
+
+class voxel_grid : public hittable {
+  public:
+    // A dense grid of nx * ny * nz cubic blocks of edge voxel_size, with the minimum corner of
+    // block (0,0,0) at origin. Each cell holds a block type ID, 0 meaning empty. Rays are
+    // walked through the cells with a 3D DDA, so faces between two solid blocks are never
+    // tested, and runs of empty space are skipped a whole brick of cells at a time.
+
+    voxel_grid(const point3& origin, int nx, int ny, int nz, double voxel_size = 1.0)
+      : origin(origin), voxel_size(voxel_size),
+        dims{ std::max(nx,1), std::max(ny,1), std::max(nz,1) }
+    {
+        cells.assign(size_t(dims[0]) * dims[1] * dims[2], 0);
+
+        for (int a = 0; a < 3; a++)
+            brick_dims[a] = (dims[a] + brick_size - 1) / brick_size;
+        brick_counts.assign(size_t(brick_dims[0]) * brick_dims[1] * brick_dims[2], 0);
+
+        bbox = aabb(origin, origin + voxel_size * vec3(dims[0], dims[1], dims[2]));
+    }
+
+    uint8_t add_block_type(
+        shared_ptr<material> side, shared_ptr<material> top, shared_ptr<material> bottom
+    ) {
+        // Registers a block type and returns its ID, for use with set(). IDs are bytes and 0
+        // is empty space, so there can be at most 255 types; past that, an error is printed
+        // and 0 is returned.
+        if (block_types.size() >= max_block_types) {
+            std::cerr << "ERROR: A voxel grid holds at most " << max_block_types
+                      << " block types.\n";
+            return 0;
+        }
+
+        block_types.push_back(voxel_block_type{side, top, bottom});
+        return uint8_t(block_types.size());
+    }
+
+    uint8_t add_block_type(shared_ptr<material> mat) {
+        return add_block_type(mat, mat, mat);
+    }
+
+    void set(int x, int y, int z, uint8_t id) {
+        if (!contains(x, y, z) || id > block_types.size())
+            return;
+
+        auto& cell = cells[cell_index(x, y, z)];
+        auto& count = brick_counts[brick_index(x, y, z)];
+        if (cell != 0) count--;
+        if (id != 0) count++;
+        cell = id;
+    }
+
+    uint8_t get(int x, int y, int z) const {
+        return contains(x, y, z) ? cells[cell_index(x, y, z)] : 0;
+    }
+
+    bool hit(const ray& r, interval ray_t, hit_record& rec) const override {
+        return march(r, ray_t,
+            [&](double t, int axis, const int* step, const int* cell, bool leaving) {
+                return record_hit(r, ray_t, t, axis, step, cell, leaving, rec);
+            });
+    }
+
+    bool occluded(const ray& r, interval ray_t) const override {
+        return march(r, ray_t, [&](double t, int, const int*, const int*, bool) {
+            return ray_t.surrounds(t);
+        });
+    }
+
+    aabb bounding_box() const override { return bbox; }
+
+  private:
+    static const int brick_size = 8;  // Edge, in cells, of the bricks used to skip empty space
+    static constexpr size_t max_block_types = 255;
+
+    point3 origin;
+    double voxel_size;
+    int dims[3];
+    int brick_dims[3];
+    std::vector<uint8_t> cells;
+    std::vector<uint32_t> brick_counts;  // Number of solid cells in each brick
+    std::vector<voxel_block_type> block_types;
+    aabb bbox;
+
+    bool contains(int x, int y, int z) const {
+        return 0 <= x && x < dims[0] && 0 <= y && y < dims[1] && 0 <= z && z < dims[2];
+    }
+
+    size_t cell_index(int x, int y, int z) const {
+        return (size_t(z) * dims[1] + y) * dims[0] + x;
+    }
+
+    size_t brick_index(int x, int y, int z) const {
+        return (size_t(z / brick_size) * brick_dims[1] + y / brick_size) * brick_dims[0]
+             + x / brick_size;
+    }
+
+    bool solid(const int cell[3]) const {
+        return cells[cell_index(cell[0], cell[1], cell[2])] != 0;
+    }
+
+    bool brick_is_empty(const int cell[3]) const {
+        return brick_counts[brick_index(cell[0], cell[1], cell[2])] == 0;
+    }
+
+    static void init_crossings(
+        const vec3& o, const vec3& d, const int cell[3], const int step[3], double t_max[3]
+    ) {
+        // Ray parameter at which the ray crosses the next cell boundary along each axis.
+        for (int a = 0; a < 3; a++) {
+            if (step[a] == 0)
+                t_max[a] = infinity;
+            else
+                t_max[a] = ((step[a] > 0 ? cell[a] + 1 : cell[a]) - o[a]) / d[a];
+        }
+    }
+
+    template <typename OnHit>
+    bool march(const ray& r, const interval& ray_t, OnHit on_hit) const {
+        // Walks the cells along the ray and returns on_hit(t, axis, step, cell, leaving) for the
+        // first block face it crosses between a block and empty space, or false if it leaves the
+        // grid first. That is the face where the ray enters a block from empty space, or, for a
+        // ray that starts inside a block, the face where it leaves the blocks around its start
+        // (leaving is then true and cell is the block the face belongs to).
+
+        // Work in grid space, where each cell is a unit cube. The ray parameter t is unchanged.
+        vec3 o = (r.origin() - origin) / voxel_size;
+        vec3 d = r.direction() / voxel_size;
+
+        // Clip the ray to the grid bounds, noting which face it enters through.
+        double t_enter = ray_t.min, t_exit = ray_t.max;
+        int entry_axis = -1;
+        for (int a = 0; a < 3; a++) {
+            if (d[a] == 0) {
+                if (o[a] < 0 || o[a] > dims[a])
+                    return false;
+                continue;
+            }
+            auto t0 = (0 - o[a]) / d[a];
+            auto t1 = (dims[a] - o[a]) / d[a];
+            if (t0 > t1) std::swap(t0, t1);
+            if (t0 > t_enter) { t_enter = t0; entry_axis = a; }
+            if (t1 < t_exit) t_exit = t1;
+            if (t_exit <= t_enter)
+                return false;
+        }
+
+        int cell[3], step[3];
+        double t_max[3], t_delta[3];
+        auto start = o + t_enter * d;
+        for (int a = 0; a < 3; a++) {
+            cell[a] = std::min(std::max(int(std::floor(start[a])), 0), dims[a] - 1);
+            step[a] = (d[a] > 0) ? 1 : (d[a] < 0) ? -1 : 0;
+            t_delta[a] = (step[a] != 0) ? std::fabs(1 / d[a]) : infinity;
+        }
+        init_crossings(o, d, cell, step, t_max);
+
+        if (solid(cell)) {
+            if (entry_axis >= 0)
+                return on_hit(t_enter, entry_axis, step, cell, false);
+
+            // The ray starts inside a block. Faces between two blocks are never hit, so it
+            // walks on through solid cells to the first face with empty space or the grid's
+            // edge beyond it.
+            while (true) {
+                int axis = next_crossing(t_max);
+                auto t = t_max[axis];
+                if (t > t_exit)
+                    return false;
+
+                auto next = cell[axis] + step[axis];
+                if (next < 0 || next >= dims[axis])
+                    return on_hit(t, axis, step, cell, true);
+
+                int neighbor[3] = { cell[0], cell[1], cell[2] };
+                neighbor[axis] = next;
+                if (!solid(neighbor))
+                    return on_hit(t, axis, step, cell, true);
+
+                cell[axis] = next;
+                t_max[axis] += t_delta[axis];
+            }
+        }
+
+        while (true) {
+            int axis;
+
+            if (brick_is_empty(cell)) {
+                // Jump straight to where the ray leaves this empty brick.
+                int lo[3], hi[3];
+                double t_leave = infinity;
+                axis = 0;
+                for (int a = 0; a < 3; a++) {
+                    lo[a] = (cell[a] / brick_size) * brick_size;
+                    hi[a] = std::min(lo[a] + brick_size, dims[a]);
+                    if (step[a] == 0) continue;
+                    auto t = ((step[a] > 0 ? hi[a] : lo[a]) - o[a]) / d[a];
+                    if (t < t_leave) { t_leave = t; axis = a; }
+                }
+
+                if (t_leave > t_exit)
+                    return false;
+
+                auto p = o + t_leave * d;
+                for (int a = 0; a < 3; a++) {
+                    if (a == axis)
+                        cell[a] = (step[a] > 0) ? hi[a] : lo[a] - 1;
+                    else
+                        cell[a] = std::min(std::max(int(std::floor(p[a])), lo[a]), hi[a] - 1);
+                }
+                if (cell[axis] < 0 || cell[axis] >= dims[axis])
+                    return false;
+
+                init_crossings(o, d, cell, step, t_max);
+
+                if (solid(cell))
+                    return on_hit(t_leave, axis, step, cell, false);
+                continue;
+            }
+
+            // Step to the neighboring cell whose boundary the ray crosses first.
+            axis = next_crossing(t_max);
+
+            auto t = t_max[axis];
+            if (t > t_exit)
+                return false;
+
+            cell[axis] += step[axis];
+            if (cell[axis] < 0 || cell[axis] >= dims[axis])
+                return false;
+            t_max[axis] += t_delta[axis];
+
+            if (solid(cell))
+                return on_hit(t, axis, step, cell, false);
+        }
+    }
+
+    static int next_crossing(const double t_max[3]) {
+        // Axis of the cell boundary the ray crosses first.
+        return (t_max[0] < t_max[1])
+             ? (t_max[0] < t_max[2] ? 0 : 2)
+             : (t_max[1] < t_max[2] ? 1 : 2);
+    }
+
+    bool record_hit(
+        const ray& r, const interval& ray_t, double t, int axis, const int step[3],
+        const int cell[3], bool leaving, hit_record& rec
+    ) const {
+        if (!ray_t.surrounds(t))
+            return false;
+
+        const auto& type = block_types[cells[cell_index(cell[0], cell[1], cell[2])] - 1];
+
+        rec.t = t;
+        rec.p = r.at(t);
+        rec.object = this;
+
+        // The ray enters (or leaves) the block through the face perpendicular to the axis it
+        // stepped along.
+        vec3 outward_normal(0,0,0);
+        outward_normal[axis] = leaving ? step[axis] : -step[axis];
+        rec.set_face_normal(r, outward_normal);
+
+        rec.mat = (axis != 1)          ? type.side
+                : (outward_normal[1] > 0) ? type.top
+                                          : type.bottom;
+
+        // Face UVs match the quads the block scenes are built from: the sides of a block map
+        // U along X (or Z) and V up Y, and the top and bottom map U along X and V along Z.
+        auto local = (rec.p - origin) / voxel_size;
+        auto fx = interval(0,1).clamp(local.x() - cell[0]);
+        auto fy = interval(0,1).clamp(local.y() - cell[1]);
+        auto fz = interval(0,1).clamp(local.z() - cell[2]);
+
+        if (axis == 0)      { rec.u = fz; rec.v = fy; }
+        else if (axis == 1) { rec.u = fx; rec.v = fz; }
+        else                { rec.u = fx; rec.v = fy; }
+
+        return true;
+    }
+};
+
+
+#endif